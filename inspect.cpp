@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <limits>
+
+#include <gst/gst.h>
+
+#define GETTEXT_PACKAGE "gstreamer_appsrcsandbox"
+
+// Commandline option parser https://developer-old.gnome.org/glib/unstable/glib-Commandline-option-parser.html
+
+static gchar* g_path = nullptr;
+static gboolean g_json = false;
+static gdouble g_interval = 1.0;
+static gboolean g_no_verify = false;
+
+static GOptionEntry g_option_context_entries[] {
+  { "path", 'p', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &g_path, "Path to record file to inspect", nullptr },
+  { "json", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_json, "Print report as JSON instead of text", nullptr },
+  { "interval", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_interval, "Interval in seconds of bitrate series", nullptr },
+  { "no-verify", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_no_verify, "Step over record checksums instead of verifying them, corrupt data is then not detected", nullptr },
+  { nullptr }
+};
+
+GST_DEBUG_CATEGORY_STATIC (inspect_category);
+#define GST_CAT_DEFAULT inspect_category
+
+#include "reader.h"
+
+// NOTE: Statistics of one stream (element identifier) collected from record headers, payloads are not looked at
+struct Stream {
+  static size_t constexpr const g_bitrate_capacity = 1 << 20; // Buffers beyond this many intervals from origin are left out of the series
+  static size_t constexpr const g_reorder_capacity = 16; // PTS are put in order within this many buffers before looking for gaps
+
+  struct Caps {
+    uint64_t buffer_index; // Caps apply from this buffer of the stream on
+    GstClockTime time; // Of that buffer
+    std::string caps_string;
+  };
+
+  void add_caps (GstCaps* caps)
+  {
+    const auto caps_string = caps ? gst_caps_to_string (caps) : nullptr;
+    caps_list.push_back ({ buffer_count, GST_CLOCK_TIME_NONE, caps_string ? caps_string : "" });
+    g_free (caps_string);
+  }
+  void add_buffer (const Reader::Record& record, GstClockTime origin)
+  {
+    const auto dts = static_cast<GstClockTime> (record.dts);
+    const auto pts = static_cast<GstClockTime> (record.pts);
+    const auto duration = static_cast<GstClockTime> (record.duration);
+    const auto time = GST_CLOCK_TIME_IS_VALID (dts) ? dts : pts;
+    if (!caps_list.empty () && caps_list.back ().buffer_index == buffer_count)
+      caps_list.back ().time = time;
+    if (GST_CLOCK_TIME_IS_VALID (time)) {
+      first_time = std::min (first_time, time);
+      last_time = GST_CLOCK_TIME_IS_VALID (last_time) ? std::max (last_time, time) : time;
+      const auto bucket = time > origin ? (time - origin) / interval : 0;
+      if (bucket < g_bitrate_capacity) {
+        if (bitrate_list.size () <= bucket)
+          bitrate_list.resize (static_cast<size_t> (bucket + 1));
+        bitrate_list[static_cast<size_t> (bucket)] += record.size;
+      } else if (!bitrate_skip_count++)
+        GST_WARNING ("Buffer at %" GST_TIME_FORMAT " is beyond the bitrate series, left out", GST_TIME_ARGS (time));
+    }
+    // NOTE: A gap is DTS beyond previous DTS and duration by more than half of that duration
+    if (!GST_CLOCK_TIME_IS_VALID (dts))
+      dts_missing_count++;
+    else if (GST_CLOCK_TIME_IS_VALID (previous_dts)) {
+      if (dts < previous_dts)
+        dts_backward_count++;
+      else if (GST_CLOCK_TIME_IS_VALID (previous_duration) && dts > previous_dts + previous_duration + previous_duration / 2) {
+        const auto gap = dts - previous_dts - previous_duration;
+        dts_gap_count++;
+        dts_gap_maximum = std::max (dts_gap_maximum, gap);
+      }
+    }
+    if (GST_CLOCK_TIME_IS_VALID (dts)) {
+      previous_dts = dts;
+      previous_duration = duration;
+    }
+    if (!GST_CLOCK_TIME_IS_VALID (pts))
+      pts_missing_count++;
+    else {
+      if (GST_CLOCK_TIME_IS_VALID (dts) && pts < dts)
+        pts_before_dts_count++;
+      pts_window.emplace (pts, duration);
+      if (pts_window.size () > g_reorder_capacity)
+        pop_pts ();
+    }
+    if (!(record.flags & GST_BUFFER_FLAG_DELTA_UNIT)) {
+      if (key_frame_count && GST_CLOCK_TIME_IS_VALID (time) && GST_CLOCK_TIME_IS_VALID (key_frame_time) && time > key_frame_time) {
+        const auto key_frame_interval = time - key_frame_time;
+        key_frame_interval_count++;
+        key_frame_interval_minimum = std::min (key_frame_interval_minimum, key_frame_interval);
+        key_frame_interval_maximum = std::max (key_frame_interval_maximum, key_frame_interval);
+        key_frame_interval_sum += key_frame_interval;
+        key_frame_interval_buffer_sum += buffer_count - key_frame_buffer_index;
+      }
+      key_frame_count++;
+      key_frame_time = time;
+      key_frame_buffer_index = buffer_count;
+    }
+    for (auto&& element : get_buffer_flag_list ())
+      if (record.flags & element.first)
+        flag_count_map[element.second]++;
+    buffer_count++;
+    size += record.size;
+  }
+  // NOTE: Buffers come in decoding order, PTS are taken in presentation order off the reorder window; a gap is PTS
+  //       beyond previous PTS and duration by more than half of that duration, as for DTS
+  void pop_pts ()
+  {
+    const auto iterator = pts_window.begin ();
+    const auto pts = iterator->first, duration = iterator->second;
+    pts_window.erase (iterator);
+    if (GST_CLOCK_TIME_IS_VALID (previous_pts) && GST_CLOCK_TIME_IS_VALID (previous_pts_duration) && pts > previous_pts + previous_pts_duration + previous_pts_duration / 2) {
+      const auto gap = pts - previous_pts - previous_pts_duration;
+      pts_gap_count++;
+      pts_gap_maximum = std::max (pts_gap_maximum, gap);
+    }
+    previous_pts = pts;
+    previous_pts_duration = duration;
+  }
+  void finish ()
+  {
+    while (!pts_window.empty ())
+      pop_pts ();
+  }
+  double get_bitrate () const
+  {
+    return GST_CLOCK_TIME_IS_VALID (last_time) && last_time > first_time ? size * 8.0 * GST_SECOND / (last_time - first_time) : 0.0;
+  }
+
+  GstClockTime interval = GST_SECOND; // Of bitrate list entries
+  uint64_t buffer_count = 0;
+  uint64_t size = 0;
+  GstClockTime first_time = GST_CLOCK_TIME_NONE; // Of buffers, DTS or PTS if there is no DTS
+  GstClockTime last_time = GST_CLOCK_TIME_NONE;
+  std::vector<Caps> caps_list;
+  std::vector<uint64_t> bitrate_list; // Bytes per interval from origin of the file
+  uint64_t bitrate_skip_count = 0; // Buffers beyond g_bitrate_capacity intervals
+  uint64_t key_frame_count = 0;
+  GstClockTime key_frame_time = GST_CLOCK_TIME_NONE;
+  uint64_t key_frame_buffer_index = 0;
+  uint64_t key_frame_interval_count = 0;
+  GstClockTime key_frame_interval_minimum = GST_CLOCK_TIME_NONE;
+  GstClockTime key_frame_interval_maximum = 0;
+  GstClockTime key_frame_interval_sum = 0;
+  uint64_t key_frame_interval_buffer_sum = 0;
+  GstClockTime previous_dts = GST_CLOCK_TIME_NONE;
+  GstClockTime previous_duration = GST_CLOCK_TIME_NONE;
+  uint64_t dts_missing_count = 0;
+  uint64_t dts_gap_count = 0;
+  GstClockTime dts_gap_maximum = 0;
+  uint64_t dts_backward_count = 0;
+  uint64_t pts_missing_count = 0;
+  uint64_t pts_before_dts_count = 0;
+  std::multimap<GstClockTime, GstClockTime> pts_window; // PTS and duration
+  GstClockTime previous_pts = GST_CLOCK_TIME_NONE;
+  GstClockTime previous_pts_duration = GST_CLOCK_TIME_NONE;
+  uint64_t pts_gap_count = 0;
+  GstClockTime pts_gap_maximum = 0;
+  std::map<std::string, uint64_t> flag_count_map;
+  bool end_of_stream = false;
+};
+
+std::string escape (const std::string& value)
+{
+  std::ostringstream stream;
+  for (auto&& character : value) {
+    if (character == '"' || character == '\\')
+      stream << '\\' << character;
+    else if (static_cast<unsigned char> (character) < 0x20) {
+      char text[8];
+      sprintf (text, "\\u%04X", static_cast<unsigned int> (character));
+      stream << text;
+    } else
+      stream << character;
+  }
+  return stream.str ();
+}
+
+std::string file_flags_to_string (uint16_t flags)
+{
+  static const std::initializer_list<std::pair<uint16_t, const char*>> g_list {
+    { AppsrcFile::g_compact_flag, "compact" },
+    { AppsrcFile::g_lz4_flag, "lz4" },
+    { AppsrcFile::g_zstd_flag, "zstd" },
+    { AppsrcFile::g_arrival_flag, "arrival" },
+    { AppsrcFile::g_checksum_flag, "checksum" },
+  };
+  std::ostringstream stream;
+  for (auto&& element : g_list)
+    if (flags & element.first)
+      stream << " | " << element.second;
+  auto string = stream.str ();
+  if (string.empty ())
+    return "none";
+  string.erase (0, 3);
+  return string;
+}
+
+int main (int argc, char* argv[])
+{
+  GError* error = nullptr;
+  GOptionContext* context = g_option_context_new ("- appsrc record file inspection");
+  g_option_context_add_main_entries (context, g_option_context_entries, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_print ("Command line parse failed: %s\n", error->message);
+    exit (1);
+  }
+
+  gst_init (&argc, &argv);
+
+  GST_DEBUG_CATEGORY_INIT (inspect_category, "inspect", 0, "Record file inspection");
+
+  // NOTE: Shorter intervals split buffers of common streams into mostly empty series entries
+  if (!g_path || !(g_interval >= 0.001)) {
+    g_print ("Usage: inspect --path <file> [--json] [--interval <seconds>] [--no-verify]\n");
+    exit (1);
+  }
+  const std::string path = g_path;
+  Reader reader;
+  reader.verify = !g_no_verify;
+  reader.verify_skipped = true;
+  if (!reader.open (path, true)) {
+    g_print ("Failed to open %s\n", path.c_str ());
+    exit (1);
+  }
+
+  // NOTE: Payloads are stepped over, only compressed blocks are still decompressed to get to the records within;
+  //       records of files with checksums are verified in the mapping, payloads included unless --no-verify
+  const auto start_time = g_get_monotonic_time ();
+  std::map<uint8_t, Stream> stream_map;
+  const auto get_stream = [&] (uint8_t element_identifier) -> Stream& {
+    auto iterator = stream_map.find (element_identifier);
+    if (iterator == stream_map.end ()) {
+      iterator = stream_map.emplace (element_identifier, Stream ()).first;
+      iterator->second.interval = static_cast<GstClockTime> (g_interval * GST_SECOND);
+    }
+    return iterator->second;
+  };
+  for (auto&& element : reader.stream_table)
+    get_stream (element.first).add_caps (reader.get_caps (element.second));
+  uint64_t record_count = 0;
+  GstClockTime origin = GST_CLOCK_TIME_NONE;
+  Reader::Record record;
+  reader.skip_payload = true;
+  for (; reader.next (record); record_count++) {
+    auto& stream = get_stream (record.element_identifier);
+    switch (record.type) {
+      case 1:
+        stream.add_caps (record.caps);
+        break;
+      case 2:
+        if (!GST_CLOCK_TIME_IS_VALID (origin))
+          origin = static_cast<GstClockTime> (record.dts != -1 ? record.dts : record.pts);
+        stream.add_buffer (record, origin);
+        break;
+      case 3:
+        stream.end_of_stream = true;
+        break;
+    }
+  }
+  for (auto&& element : stream_map)
+    element.second.finish ();
+  const auto parse_time = g_get_monotonic_time () - start_time;
+  const auto file_size = reader.mapping ? reader.mapping->size : 0;
+
+  const auto seconds = [] (GstClockTime value) { return GST_CLOCK_TIME_IS_VALID (value) ? value / 1E9 : 0.0; };
+  std::ostringstream stream;
+  stream.precision (3);
+  stream << std::fixed;
+  if (g_json) {
+    stream << "{\n  \"path\": \"" << escape (path) << "\",\n";
+    stream << "  \"version\": " << reader.version << ",\n";
+    stream << "  \"flags\": \"" << file_flags_to_string (reader.flags) << "\",\n";
+    stream << "  \"declared_streams\": " << reader.stream_table.size () << ",\n";
+    stream << "  \"caps\": " << reader.caps_list.size () << ",\n";
+    stream << "  \"indexed_streams\": " << reader.index.entry_map.size () << ",\n";
+    stream << "  \"records\": " << record_count << ",\n";
+    if (reader.verify) {
+      stream << "  \"corrupt_ranges\": " << reader.corrupt_count << ",\n";
+      stream << "  \"corrupt_bytes\": " << reader.corrupt_size << ",\n";
+    } else
+      stream << "  \"corrupt_ranges\": null,\n  \"corrupt_bytes\": null,\n";
+    stream << "  \"bytes\": " << file_size << ",\n";
+    stream << "  \"parse_time\": " << parse_time / 1E6 << ",\n";
+    stream << "  \"streams\": [";
+    bool first = true;
+    for (auto&& element : stream_map) {
+      const auto& stream_statistics = element.second;
+      stream << (std::exchange (first, false) ? "\n" : ",\n") << "    {\n";
+      stream << "      \"element_identifier\": " << static_cast<unsigned int> (element.first) << ",\n";
+      stream << "      \"buffers\": " << stream_statistics.buffer_count << ",\n";
+      stream << "      \"bytes\": " << stream_statistics.size << ",\n";
+      stream << "      \"first_time\": " << seconds (stream_statistics.first_time) << ",\n";
+      stream << "      \"last_time\": " << seconds (stream_statistics.last_time) << ",\n";
+      stream << "      \"bitrate\": " << stream_statistics.get_bitrate () << ",\n";
+      stream << "      \"bitrate_interval\": " << g_interval << ",\n";
+      stream << "      \"bitrate_series_skipped\": " << stream_statistics.bitrate_skip_count << ",\n";
+      stream << "      \"bitrate_series\": [";
+      for (size_t index = 0; index < stream_statistics.bitrate_list.size (); index++)
+        stream << (index ? ", " : "") << stream_statistics.bitrate_list[index] * 8.0 / g_interval;
+      stream << "],\n      \"caps\": [";
+      for (size_t index = 0; index < stream_statistics.caps_list.size (); index++) {
+        const auto& caps = stream_statistics.caps_list[index];
+        stream << (index ? "," : "") << "\n        { \"buffer\": " << caps.buffer_index << ", \"time\": " << seconds (caps.time) << ", \"caps\": \"" << escape (caps.caps_string) << "\" }";
+      }
+      stream << (stream_statistics.caps_list.empty () ? "" : "\n      ") << "],\n";
+      stream << "      \"key_frames\": { \"count\": " << stream_statistics.key_frame_count;
+      if (stream_statistics.key_frame_interval_count)
+        stream << ", \"interval_minimum\": " << seconds (stream_statistics.key_frame_interval_minimum) << ", \"interval_mean\": " << seconds (stream_statistics.key_frame_interval_sum / stream_statistics.key_frame_interval_count) << ", \"interval_maximum\": " << seconds (stream_statistics.key_frame_interval_maximum) << ", \"interval_buffers_mean\": " << static_cast<double> (stream_statistics.key_frame_interval_buffer_sum) / stream_statistics.key_frame_interval_count;
+      stream << " },\n";
+      stream << "      \"dts\": { \"missing\": " << stream_statistics.dts_missing_count << ", \"gaps\": " << stream_statistics.dts_gap_count << ", \"gap_maximum\": " << seconds (stream_statistics.dts_gap_maximum) << ", \"backwards\": " << stream_statistics.dts_backward_count << " },\n";
+      stream << "      \"pts\": { \"missing\": " << stream_statistics.pts_missing_count << ", \"gaps\": " << stream_statistics.pts_gap_count << ", \"gap_maximum\": " << seconds (stream_statistics.pts_gap_maximum) << ", \"before_dts\": " << stream_statistics.pts_before_dts_count << " },\n";
+      stream << "      \"flags\": {";
+      bool first_flag = true;
+      for (auto&& flag : stream_statistics.flag_count_map)
+        stream << (std::exchange (first_flag, false) ? " " : ", ") << "\"" << flag.first << "\": " << flag.second;
+      stream << (stream_statistics.flag_count_map.empty () ? "" : " ") << "},\n";
+      stream << "      \"end_of_stream\": " << (stream_statistics.end_of_stream ? "true" : "false") << "\n";
+      stream << "    }";
+    }
+    stream << "\n  ]\n}\n";
+  } else {
+    stream << path << ": version " << reader.version << ", flags " << file_flags_to_string (reader.flags) << ", " << reader.stream_table.size () << " declared streams, " << reader.caps_list.size () << " caps, " << reader.index.entry_map.size () << " indexed streams\n";
+    stream << record_count << " records, " << file_size / 1E6 << " MB parsed in " << parse_time / 1E6 << " s\n";
+    if ((reader.flags & AppsrcFile::g_checksum_flag) && !reader.verify)
+      stream << "Checksums: not verified\n";
+    else if (reader.flags & AppsrcFile::g_checksum_flag)
+      stream << "Checksums: " << (reader.corrupt_count ? std::to_string (reader.corrupt_count) + " ranges of corrupt data skipped, " + std::to_string (reader.corrupt_size) + " bytes" : std::string ("all records valid")) << "\n";
+    for (auto&& element : stream_map) {
+      const auto& stream_statistics = element.second;
+      stream << "Stream " << static_cast<unsigned int> (element.first) << ": " << stream_statistics.buffer_count << " buffers, " << stream_statistics.size / 1E6 << " MB, " << seconds (stream_statistics.first_time) << " - " << seconds (stream_statistics.last_time) << " s, " << stream_statistics.get_bitrate () / 1E3 << " kbit/s" << (stream_statistics.end_of_stream ? ", end of stream" : "") << "\n";
+      for (auto&& caps : stream_statistics.caps_list)
+        stream << "  caps from buffer " << caps.buffer_index << " (" << seconds (caps.time) << " s): " << caps.caps_string << "\n";
+      stream << "  key frames: " << stream_statistics.key_frame_count;
+      if (stream_statistics.key_frame_interval_count)
+        stream << ", interval " << seconds (stream_statistics.key_frame_interval_minimum) << " / " << seconds (stream_statistics.key_frame_interval_sum / stream_statistics.key_frame_interval_count) << " / " << seconds (stream_statistics.key_frame_interval_maximum) << " s (minimum / mean / maximum), " << static_cast<double> (stream_statistics.key_frame_interval_buffer_sum) / stream_statistics.key_frame_interval_count << " buffers mean";
+      stream << "\n";
+      stream << "  DTS: " << stream_statistics.dts_missing_count << " missing, " << stream_statistics.dts_gap_count << " gaps up to " << seconds (stream_statistics.dts_gap_maximum) << " s, " << stream_statistics.dts_backward_count << " backwards; PTS: " << stream_statistics.pts_missing_count << " missing, " << stream_statistics.pts_gap_count << " gaps up to " << seconds (stream_statistics.pts_gap_maximum) << " s, " << stream_statistics.pts_before_dts_count << " before DTS\n";
+      stream << "  flags:";
+      for (auto&& flag : stream_statistics.flag_count_map)
+        stream << " " << flag.first << " " << flag.second;
+      stream << (stream_statistics.flag_count_map.empty () ? " none\n" : "\n");
+      stream << "  kbit/s per " << g_interval << " s:";
+      for (auto&& size : stream_statistics.bitrate_list)
+        stream << " " << size * 8.0 / g_interval / 1E3;
+      if (stream_statistics.bitrate_skip_count)
+        stream << " (" << stream_statistics.bitrate_skip_count << " buffers beyond " << Stream::g_bitrate_capacity << " intervals left out)";
+      stream << "\n";
+    }
+  }
+  g_print ("%s", stream.str ().c_str ());
+  return 0;
+}
@@ -0,0 +1,1120 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <gst/gst.h>
+
+// NOTE: The header which creates appsrc replay files, also defines layout of index and footer records
+#include "record.h"
+
+#if defined(WIN32)
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+// NOTE: Reading side of record files, shared by replay and inspection; logging goes to GST_CAT_DEFAULT as defined
+//       where the header is included
+
+template<typename ValueType>
+bool read (std::istream& stream, ValueType& value)
+{
+  stream.read (reinterpret_cast<char*> (&value), sizeof value);
+  return !stream.fail ();
+}
+// NOTE: Appends raw bytes of a varint, up to 10 bytes
+inline bool read_varint (std::istream& stream, uint8_t* data, size_t& size)
+{
+  const auto buffer = stream.rdbuf ();
+  for (size_t index = 0; index < 10; index++) {
+    const auto character = buffer->sbumpc ();
+    if (character == std::char_traits<char>::eof ()) {
+      stream.setstate (std::ios_base::eofbit | std::ios_base::failbit);
+      return false;
+    }
+    data[size++] = static_cast<uint8_t> (character);
+    if (!(character & 0x80))
+      return true;
+  }
+  return false;
+}
+inline bool read_caps_string (std::istream& stream, std::string& caps_string)
+{
+  uint16_t size;
+  if (!read (stream, size))
+    return false;
+  caps_string.resize (size);
+  stream.read (caps_string.data (), caps_string.size ());
+  return !stream.fail ();
+}
+inline bool read_caps_dictionary (std::istream& stream, std::vector<std::string>& caps_string_list)
+{
+  uint16_t count;
+  if (!read (stream, count))
+    return false;
+  caps_string_list.resize (count);
+  for (auto&& caps_string : caps_string_list)
+    if (!read_caps_string (stream, caps_string))
+      return false;
+  return true;
+}
+
+// NOTE: Key frame index written by AppsrcFile on close, located through the footer at the end of the file
+struct Index {
+  bool load (std::istream& stream)
+  {
+    const auto load = [&] {
+      stream.seekg (0, std::ios_base::end);
+      const auto size = static_cast<uint64_t> (stream.tellg ());
+      if (size < AppsrcFile::g_footer_size)
+        return false;
+      stream.seekg (size - AppsrcFile::g_footer_size);
+      uint8_t type, element_identifier;
+      uint64_t offset;
+      char magic[sizeof AppsrcFile::g_footer_magic];
+      if (!read (stream, type) || !read (stream, element_identifier) || !read (stream, offset) || !read (stream, magic))
+        return false;
+      if (type != AppsrcFile::g_footer_identifier || memcmp (magic, AppsrcFile::g_footer_magic, sizeof magic) != 0 || offset >= size)
+        return false;
+      stream.seekg (offset);
+      uint64_t index_size;
+      if (!read (stream, type) || !read (stream, element_identifier) || !read (stream, index_size))
+        return false;
+      if (type != AppsrcFile::g_index_identifier)
+        return false;
+      for (uint64_t position = 0; position < index_size;) {
+        uint8_t tag;
+        uint64_t section_size;
+        if (!read (stream, tag) || !read (stream, section_size))
+          return false;
+        position += 1 + sizeof section_size + section_size;
+        if (tag == AppsrcFile::g_index_caps_section) {
+          if (!read_caps_dictionary (stream, caps_string_list))
+            return false;
+          continue;
+        }
+        if (tag == AppsrcFile::g_index_block_section) {
+          block_entry_list.resize (section_size / (sizeof (uint64_t) + 2 * sizeof (uint32_t)));
+          for (auto&& entry : block_entry_list)
+            if (!read (stream, entry.offset) || !read (stream, entry.size) || !read (stream, entry.compressed_size))
+              return false;
+          continue;
+        }
+        const auto block = tag == AppsrcFile::g_index_block_key_frame_section;
+        if (tag != AppsrcFile::g_index_key_frame_section && !block) {
+          stream.seekg (section_size, std::ios_base::cur);
+          continue;
+        }
+        for (uint64_t count = section_size / (AppsrcFile::IndexEntry::g_size + (block ? 2 * sizeof (uint32_t) : 0)); count; count--) {
+          AppsrcFile::IndexEntry entry;
+          if (!read (stream, entry.element_identifier) || !read (stream, entry.offset) || !read (stream, entry.caps_offset) || !read (stream, entry.dts) || !read (stream, entry.pts))
+            return false;
+          if (block && (!read (stream, entry.block_offset) || !read (stream, entry.caps_block_offset)))
+            return false;
+          entry_map[entry.element_identifier].emplace_back (entry);
+        }
+      }
+      return true;
+    };
+    entry_map.clear ();
+    caps_string_list.clear ();
+    block_entry_list.clear ();
+    const auto result = load ();
+    if (!result) {
+      entry_map.clear ();
+      caps_string_list.clear ();
+      block_entry_list.clear ();
+    }
+    stream.clear ();
+    stream.seekg (0);
+    return result;
+  }
+  // NOTE: For each stream, last indexed key frame at or before the time, or first one if the stream starts later
+  std::vector<AppsrcFile::IndexEntry> seek (GstClockTime time) const
+  {
+    std::vector<AppsrcFile::IndexEntry> entry_list;
+    for (auto&& element : entry_map) {
+      auto& stream_entry_list = element.second;
+      auto iterator = std::upper_bound (stream_entry_list.cbegin (), stream_entry_list.cend (), time, [] (GstClockTime time, auto&& entry) { return time < entry.time (); });
+      if (iterator != stream_entry_list.cbegin ())
+        iterator--;
+      entry_list.emplace_back (*iterator);
+    }
+    return entry_list;
+  }
+
+  std::map<uint8_t, std::vector<AppsrcFile::IndexEntry>> entry_map;
+  std::vector<std::string> caps_string_list; // Complete caps dictionary
+  std::vector<AppsrcFile::BlockEntry> block_entry_list;
+};
+
+// NOTE: Read-only mapping of a whole file, reference counted so that buffers wrapping mapped payloads keep it alive
+//       for as long as they are in the pipeline, reader or not
+struct Mapping {
+  static Mapping* create (const std::string& path)
+  {
+#if defined(WIN32)
+    const auto file = CreateFileA (path.c_str (), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return nullptr;
+    LARGE_INTEGER size;
+    void* data = nullptr;
+    if (GetFileSizeEx (file, &size) && size.QuadPart > 0) {
+      const auto file_mapping = CreateFileMappingA (file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (file_mapping) {
+        data = MapViewOfFile (file_mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle (file_mapping);
+      }
+    }
+    CloseHandle (file);
+    if (!data)
+      return nullptr;
+    return new Mapping (reinterpret_cast<const uint8_t*> (data), static_cast<size_t> (size.QuadPart));
+#else
+    const auto descriptor = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0)
+      return nullptr;
+    struct stat status;
+    auto data = MAP_FAILED;
+    if (fstat (descriptor, &status) == 0 && status.st_size > 0)
+      data = mmap (nullptr, static_cast<size_t> (status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+    ::close (descriptor);
+    if (data == MAP_FAILED)
+      return nullptr;
+    madvise (data, static_cast<size_t> (status.st_size), MADV_SEQUENTIAL);
+    return new Mapping (reinterpret_cast<const uint8_t*> (data), static_cast<size_t> (status.st_size));
+#endif
+  }
+  Mapping* ref ()
+  {
+    reference_count++;
+    return this;
+  }
+  static void unref (gpointer data)
+  {
+    const auto mapping = reinterpret_cast<Mapping*> (data);
+    if (--mapping->reference_count == 0)
+      delete mapping;
+  }
+
+  const uint8_t* data;
+  size_t size;
+
+private:
+  Mapping (const uint8_t* data, size_t size) :
+    data (data),
+    size (size)
+  {
+  }
+  ~Mapping ()
+  {
+#if defined(WIN32)
+    UnmapViewOfFile (data);
+#else
+    munmap (const_cast<uint8_t*> (data), size);
+#endif
+  }
+
+  std::atomic<int> reference_count = 1;
+};
+
+// NOTE: Size-classed recycling of payload memory for replayed buffers: blocks of power of two sizes go back to their
+//       class once downstream releases the buffer, and the pool is reference counted like Mapping so that it outlives
+//       buffers still in the pipeline; blocks are kept until the pool goes away, so the pool grows up to the peak
+// NOTE: Recycles payload memory only; every buffer still takes a GstBuffer and a GstMemory wrapping the block, which
+//       GStreamer allocates from its own slice allocator
+struct PayloadPool {
+  static unsigned int constexpr const g_minimal_class = 6; // 64 bytes, small audio and data packets
+  static unsigned int constexpr const g_class_count = 32 - g_minimal_class;
+
+  struct alignas (16) Block {
+    PayloadPool* pool;
+    unsigned int class_index;
+  };
+
+  static PayloadPool* create ()
+  {
+    return new PayloadPool;
+  }
+  PayloadPool* ref ()
+  {
+    reference_count++;
+    return this;
+  }
+  static void unref (gpointer data)
+  {
+    const auto pool = reinterpret_cast<PayloadPool*> (data);
+    if (--pool->reference_count == 0)
+      delete pool;
+  }
+
+  static size_t get_class_size (unsigned int class_index)
+  {
+    return static_cast<size_t> (1) << (g_minimal_class + class_index);
+  }
+  // NOTE: Returns buffer of the given size backed by a pooled block, and writable data pointer of the block
+  GstBuffer* acquire (size_t size, uint8_t*& data)
+  {
+    unsigned int class_index = 0;
+    while (get_class_size (class_index) < size)
+      class_index++;
+    g_assert_true (class_index < g_class_count);
+    const auto class_size = get_class_size (class_index);
+    Block* block = nullptr;
+    {
+      std::unique_lock lock (mutex);
+      auto& free_list = free_list_array[class_index];
+      if (!free_list.empty ()) {
+        block = free_list.back ();
+        free_list.pop_back ();
+        free_size -= class_size;
+        hit_count++;
+      } else
+        miss_count++;
+      outstanding_size += class_size;
+      peak_outstanding_size = std::max (peak_outstanding_size, outstanding_size);
+    }
+    if (!block) {
+      block = static_cast<Block*> (g_malloc (sizeof (Block) + class_size));
+      block->pool = this;
+      block->class_index = class_index;
+    }
+    ref ();
+    data = reinterpret_cast<uint8_t*> (block + 1);
+    return gst_buffer_new_wrapped_full (static_cast<GstMemoryFlags> (0), data, class_size, 0, size, block, &release);
+  }
+  static void release (gpointer data)
+  {
+    const auto block = reinterpret_cast<Block*> (data);
+    const auto pool = block->pool;
+    const auto class_size = get_class_size (block->class_index);
+    std::vector<Block*> trim_list;
+    {
+      std::unique_lock lock (pool->mutex);
+      pool->outstanding_size -= class_size;
+      pool->free_list_array[block->class_index].push_back (block);
+      pool->free_size += class_size;
+      // NOTE: Past the high-water mark free blocks go back to the heap, largest first, so that a burst of large
+      //       payloads is not held on to for the rest of the replay
+      for (auto class_index = g_class_count; pool->free_size > pool->free_capacity && class_index--;)
+        for (auto& free_list = pool->free_list_array[class_index]; pool->free_size > pool->free_capacity && !free_list.empty (); free_list.pop_back ()) {
+          trim_list.push_back (free_list.back ());
+          pool->free_size -= get_class_size (class_index);
+          pool->trim_count++;
+        }
+    }
+    for (auto&& trim_block : trim_list)
+      g_free (trim_block);
+    unref (pool);
+  }
+
+  uint64_t hit_count = 0;
+  uint64_t miss_count = 0;
+  uint64_t trim_count = 0; // Blocks freed rather than kept past free_capacity
+  uint64_t outstanding_size = 0;
+  uint64_t peak_outstanding_size = 0;
+  uint64_t free_size = 0;
+  uint64_t free_capacity = 64 << 20; // High-water mark of memory kept in free lists
+  std::mutex mutex; // Guards free lists and counters
+
+private:
+  PayloadPool () = default;
+  ~PayloadPool ()
+  {
+    for (auto&& free_list : free_list_array)
+      for (auto&& block : free_list)
+        g_free (block);
+  }
+
+  std::atomic<int> reference_count = 1;
+  std::vector<Block*> free_list_array[g_class_count];
+};
+
+// NOTE: Read-only stream buffer over memory (uncompressed block data or mapped file), seekable within
+struct MemoryBuffer : std::streambuf {
+  void set (const void* data, size_t size)
+  {
+    const auto begin = const_cast<char*> (reinterpret_cast<const char*> (data));
+    setg (begin, begin, begin + size);
+  }
+  size_t remaining () const
+  {
+    return static_cast<size_t> (egptr () - gptr ());
+  }
+
+protected:
+  pos_type seekoff (off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override
+  {
+    const auto base = direction == std::ios_base::beg ? eback () : direction == std::ios_base::cur ? gptr () : egptr ();
+    if (offset < eback () - base || offset > egptr () - base)
+      return pos_type (off_type (-1));
+    setg (eback (), base + offset, egptr ());
+    return pos_type (gptr () - eback ());
+  }
+  pos_type seekpos (pos_type position, std::ios_base::openmode mode) override
+  {
+    return seekoff (off_type (position), std::ios_base::beg, mode);
+  }
+};
+
+// NOTE: Reads and decompresses blocks ahead of the reader on a separate thread, so that decompression overlaps with
+//       pushing; the thread walks block records from a given offset and stops at first record of another type
+struct BlockPrefetch {
+  static size_t constexpr const g_capacity = 4;
+
+  struct Block {
+    uint64_t offset;
+    std::vector<uint8_t> data;
+    bool valid;
+  };
+
+  ~BlockPrefetch ()
+  {
+    stop ();
+  }
+
+  void start (uint64_t offset)
+  {
+    stop ();
+    start_offset = offset;
+    termination = false;
+    completed = false;
+    handed_out = false;
+    thread = std::thread ([this, offset] { run (offset); });
+  }
+  void stop ()
+  {
+    if (thread.joinable ()) {
+      {
+        std::unique_lock lock (mutex);
+        termination = true;
+        condition.notify_all ();
+      }
+      thread.join ();
+    }
+    block_list.clear ();
+  }
+  // NOTE: Hands out decompressed block at the offset, prefetching restarts from there if the reader moved elsewhere
+  //       (including back to a block handed out before); fails only if a run started at the offset has nothing
+  bool get (uint64_t offset, std::vector<uint8_t>& data)
+  {
+    for (;;) {
+      if (!thread.joinable ())
+        start (offset);
+      std::unique_lock lock (mutex);
+      condition.wait (lock, [&] { return !block_list.empty () || completed; });
+      if (!block_list.empty () && block_list.front ().offset == offset) {
+        auto block = std::move (block_list.front ());
+        block_list.pop_front ();
+        condition.notify_all ();
+        handed_out = true;
+        std::swap (data, block.data);
+        return block.valid;
+      }
+      if (block_list.empty () && start_offset == offset && !handed_out)
+        return false;
+      lock.unlock ();
+      start (offset);
+    }
+  }
+  void run (uint64_t offset)
+  {
+    std::ifstream stream (path, std::ios_base::in | std::ios_base::binary);
+    stream.seekg (offset);
+    std::vector<uint8_t> compressed_data;
+    for (;;) {
+      {
+        std::unique_lock lock (mutex);
+        condition.wait (lock, [&] { return block_list.size () < g_capacity || termination; });
+        if (termination)
+          break;
+      }
+      uint8_t type, element_identifier, compression;
+      uint32_t size, compressed_size;
+      if (!read (stream, type) || type != AppsrcFile::g_block_identifier)
+        break;
+      if (!read (stream, element_identifier) || !read (stream, compression) || !read (stream, size) || !read (stream, compressed_size))
+        break;
+      // NOTE: Header and record checksums are verified by the reader, if at all
+      if (checksum)
+        stream.seekg (sizeof (uint32_t), std::ios_base::cur);
+      Block block { offset, std::vector<uint8_t> (size), false };
+      compressed_data.resize (compressed_size);
+      stream.read (reinterpret_cast<char*> (compressed_data.data ()), compressed_data.size ());
+      block.valid = !stream.fail () && AppsrcFile::decompress_block (compression, compressed_data.data (), compressed_data.size (), block.data.data (), block.data.size ());
+      if (!block.valid)
+        GST_ERROR ("Failed to read block at offset %" G_GUINT64_FORMAT, offset);
+      offset += AppsrcFile::g_block_header_size + compressed_size;
+      if (checksum) {
+        stream.seekg (sizeof (uint32_t), std::ios_base::cur);
+        offset += 2 * sizeof (uint32_t);
+      }
+      std::unique_lock lock (mutex);
+      const auto valid = block.valid;
+      block_list.emplace_back (std::move (block));
+      condition.notify_all ();
+      if (!valid)
+        break;
+    }
+    std::unique_lock lock (mutex);
+    completed = true;
+    condition.notify_all ();
+  }
+
+  std::string path;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Block> block_list;
+  uint64_t start_offset = 0;
+  bool checksum = false; // Block records are followed by checksums, verified by the reader
+  bool termination = false;
+  bool completed = false;
+  bool handed_out = false; // A block of the current run was handed out
+};
+
+// NOTE: Sequential reader of record files, both headerless version 1 and versioned ones; caps are parsed once per
+//       distinct caps string, all of them upfront when the file has a header or an index
+struct Reader {
+  struct Record {
+    uint8_t type; // 1 - caps, 2 - buffer, 3 - end of stream
+    uint8_t element_identifier;
+    GstCaps* caps; // Owned by reader
+    uint64_t flags;
+    int64_t dts;
+    int64_t pts;
+    int64_t duration;
+    GstClockTime arrival = GST_CLOCK_TIME_NONE; // Offset from start of recording the buffer was handed over at
+    std::vector<uint8_t> data; // Payload, empty if mapped_data or buffer is set
+    const uint8_t* mapped_data; // Payload in place within mapping of the file
+    size_t mapped_size;
+    GstBuffer* buffer = nullptr; // Payload read into pooled buffer, to be taken over by the caller
+    uint64_t size = 0; // Payload size, also when the payload is skipped
+    uint64_t offset = 0; // File offset of the payload, zero within compressed blocks
+
+    ~Record ()
+    {
+      if (buffer)
+        gst_buffer_unref (buffer);
+    }
+  };
+  struct KeyFrame {
+    uint8_t element_identifier;
+    std::pair<uint64_t, uint32_t> position; // Offset and block offset as for seek
+    GstClockTime time;
+    GstCaps* caps; // Caps in effect at the key frame, owned by reader
+  };
+  // NOTE: Where reading starts for a start time, see find_start
+  struct Start {
+    std::pair<uint64_t, uint32_t> position; // Offset and block offset as for seek
+    bool synchronized = true;
+    bool scan = false; // Compact records without index are reached by reading through from the beginning
+    std::vector<KeyFrame> key_frame_list; // Of the selected streams, empty if reading starts from the beginning
+  };
+  // NOTE: Drops leading buffers of a stream in front of the key frame it starts with, that is delta units and
+  //       buffers before the key frame time (if any, otherwise the stream starts on its first key frame). Header
+  //       buffers (e.g. in-band parameter sets) are needed to decode the key frame, they are kept
+  struct StartFilter {
+    bool skip (const Record& record)
+    {
+      if (!pending || (record.flags & GST_BUFFER_FLAG_HEADER))
+        return false;
+      const auto time = static_cast<GstClockTime> (record.dts != -1 ? record.dts : record.pts);
+      if ((record.flags & GST_BUFFER_FLAG_DELTA_UNIT) || (GST_CLOCK_TIME_IS_VALID (key_frame_time) && (!GST_CLOCK_TIME_IS_VALID (time) || time < key_frame_time)))
+        return true;
+      pending = false;
+      return false;
+    }
+
+    bool pending = true; // Stream has not reached its key frame yet
+    GstClockTime key_frame_time = GST_CLOCK_TIME_NONE;
+  };
+
+  ~Reader ()
+  {
+    for (auto&& caps : caps_list)
+      if (caps)
+        gst_caps_unref (std::exchange (caps, nullptr));
+    if (mapping)
+      Mapping::unref (std::exchange (mapping, nullptr));
+    if (pool)
+      PayloadPool::unref (std::exchange (pool, nullptr));
+  }
+
+  // NOTE: With mapped, records are parsed from memory and payloads outside of compressed blocks are not copied; a
+  //       mapping already set is used as is, readers can share one
+  bool open (const std::string& path, bool mapped = false)
+  {
+    prefetch.path = path;
+    if (mapped) {
+      if (!mapping)
+        mapping = Mapping::create (path);
+      if (mapping) {
+        mapped_buffer.set (mapping->data, mapping->size);
+        stream.rdbuf (&mapped_buffer);
+      }
+    } else if (file_buffer.open (path, std::ios_base::in | std::ios_base::binary))
+      stream.rdbuf (&file_buffer);
+    if (!mapping && !file_buffer.is_open ()) {
+      GST_ERROR ("Failed to open %s", path.c_str ());
+      return false;
+    }
+    stream.seekg (0, std::ios_base::end);
+    file_size = static_cast<uint64_t> (stream.tellg ());
+    stream.seekg (0);
+    char magic[sizeof AppsrcFile::g_header_magic];
+    if (read (stream, magic) && memcmp (magic, AppsrcFile::g_header_magic, sizeof magic) == 0) {
+      uint32_t size;
+      uint8_t stream_count;
+      if (!read (stream, version) || !read (stream, flags) || !read (stream, size)) {
+        GST_ERROR ("Truncated header in %s", path.c_str ());
+        return false;
+      }
+      if (version < 2 || version > AppsrcFile::g_version || (flags & ~AppsrcFile::g_supported_flags) != 0) {
+        GST_ERROR ("Incompatible file %s, version %u, flags 0x%04X (supported version %u, flags 0x%04X)", path.c_str (), version, flags, AppsrcFile::g_version, AppsrcFile::g_supported_flags);
+        return false;
+      }
+      // NOTE: Records are verified in place before they are parsed, which takes a mapping of the file
+      if ((flags & AppsrcFile::g_checksum_flag) && verify && !mapping && (mapping = Mapping::create (path))) {
+        const auto position = stream.tellg ();
+        mapped_buffer.set (mapping->data, mapping->size);
+        stream.rdbuf (&mapped_buffer);
+        stream.seekg (position);
+        file_buffer.close ();
+      }
+      prefetch.checksum = (flags & AppsrcFile::g_checksum_flag) != 0;
+      const auto header_offset = static_cast<uint64_t> (stream.tellg ());
+      std::vector<std::string> caps_string_list;
+      if (!read (stream, stream_count)) {
+        GST_ERROR ("Truncated header in %s", path.c_str ());
+        return false;
+      }
+      for (; stream_count; stream_count--) {
+        std::pair<uint8_t, uint16_t> element;
+        if (!read (stream, element.first) || !read (stream, element.second))
+          break;
+        stream_table.emplace_back (element);
+      }
+      if (stream.fail () || !read_caps_dictionary (stream, caps_string_list)) {
+        GST_ERROR ("Truncated header in %s", path.c_str ());
+        return false;
+      }
+      for (uint16_t caps_identifier = 0; caps_identifier < caps_string_list.size (); caps_identifier++)
+        add_caps (caps_identifier, caps_string_list[caps_identifier]);
+      data_offset = header_offset + size;
+    } else
+      version = 1;
+    if (index.load (stream))
+      for (uint16_t caps_identifier = 0; caps_identifier < index.caps_string_list.size (); caps_identifier++)
+        add_caps (caps_identifier, index.caps_string_list[caps_identifier]);
+    GST_INFO ("%s: version %u, flags 0x%04X, %zu streams declared, %zu caps, %zu indexed streams", path.c_str (), version, flags, stream_table.size (), caps_list.size (), index.entry_map.size ());
+    seek (data_offset, 0, true);
+    return true;
+  }
+  // NOTE: Compact buffer records depend on previous records of the stream, after a seek into the middle of the file
+  //       they are skipped until the stream reaches a sync record
+  //       With compression, offset is that of the block record and block offset is that of the record within the block
+  void seek (uint64_t offset, uint32_t block_offset = 0, bool synchronized = false)
+  {
+    stream.clear ();
+    stream.seekg (offset);
+    block_active = false;
+    pending_block_offset = block_offset;
+    pending_arrival = GST_CLOCK_TIME_NONE;
+    checksum_pending = false;
+    std::fill (std::begin (compact_state_list), std::end (compact_state_list), AppsrcFile::CompactState ());
+    std::fill (std::begin (synchronized_list), std::end (synchronized_list), synchronized);
+  }
+  // NOTE: Position of the next record as for seek, within the current block if there are records left in it
+  std::pair<uint64_t, uint32_t> get_position ()
+  {
+    if (block_active && block_buffer.remaining () != 0)
+      return std::make_pair (block_record_offset, static_cast<uint32_t> (block_stream.tellg ()));
+    return std::make_pair (static_cast<uint64_t> (stream.tellg ()) + (checksum_pending ? sizeof (uint32_t) : 0), static_cast<uint32_t> (0));
+  }
+  // NOTE: Reads forward from the start of data up to the position stepping over payloads, so that compact records
+  //       have the state of the records before them
+  void skip_to (std::pair<uint64_t, uint32_t> position)
+  {
+    seek (data_offset, 0, true);
+    Record record;
+    skip_payload = true;
+    while (get_position () < position && next (record))
+      ;
+    skip_payload = false;
+  }
+  // NOTE: Finds for each stream the last key frame at or before the time reading records from the start of data with
+  //       payloads stepped over, the substitute for an index; scanning stops once every stream seen or declared has
+  //       gone past the time
+  std::vector<KeyFrame> scan (GstClockTime time)
+  {
+    std::map<uint8_t, KeyFrame> key_frame_map;
+    std::map<uint8_t, GstCaps*> caps_map;
+    std::map<uint8_t, bool> passed_map;
+    for (auto&& element : stream_table) {
+      caps_map[element.first] = get_caps (element.second);
+      passed_map[element.first] = false;
+    }
+    seek (data_offset, 0, true);
+    Record record;
+    skip_payload = true;
+    for (;;) {
+      const auto position = get_position ();
+      if (!next (record))
+        break;
+      if (record.type == 1)
+        caps_map[record.element_identifier] = record.caps;
+      if (record.type != 2)
+        continue;
+      const auto record_time = static_cast<GstClockTime> (record.dts != -1 ? record.dts : record.pts);
+      if (!GST_CLOCK_TIME_IS_VALID (record_time))
+        continue;
+      if (record_time > time) {
+        passed_map[record.element_identifier] = true;
+        if (std::all_of (passed_map.cbegin (), passed_map.cend (), [] (auto&& element) { return element.second; }))
+          break;
+        continue;
+      }
+      passed_map.emplace (record.element_identifier, false);
+      if (!(record.flags & GST_BUFFER_FLAG_DELTA_UNIT))
+        key_frame_map[record.element_identifier] = { record.element_identifier, position, record_time, caps_map[record.element_identifier] };
+    }
+    skip_payload = false;
+    std::vector<KeyFrame> key_frame_list;
+    for (auto&& element : key_frame_map)
+      key_frame_list.emplace_back (element.second);
+    return key_frame_list;
+  }
+  // NOTE: Key frame of each stream at or before the time along with the caps in effect there, looked up in the index
+  //       if there is one and scanned for otherwise; the read position is left undefined
+  std::vector<KeyFrame> find_key_frames (GstClockTime time)
+  {
+    if (index.entry_map.empty ()) {
+      GST_INFO ("No index found, scanning for key frames");
+      return scan (time);
+    }
+    std::vector<KeyFrame> key_frame_list;
+    Record record;
+    for (auto&& entry : index.seek (time)) {
+      KeyFrame key_frame { entry.element_identifier, std::make_pair (entry.offset, entry.block_offset), entry.time (), nullptr };
+      // NOTE: Caps records in front of the starting point are otherwise skipped
+      if (entry.caps_offset != std::numeric_limits<uint64_t>::max ()) {
+        seek (entry.caps_offset, entry.caps_block_offset);
+        if (next (record) && record.type == 1)
+          key_frame.caps = record.caps;
+      }
+      key_frame_list.emplace_back (key_frame);
+    }
+    return key_frame_list;
+  }
+  // NOTE: Each selected stream starts with its key frame at or before the time and reading starts from the earliest
+  //       of these; streams without one start on their first key frame. Without key frames reading starts from the
+  //       beginning. The read position is left undefined, see seek_start
+  template<typename Selection>
+  Start find_start (GstClockTime time, Selection selection)
+  {
+    Start start { std::make_pair (data_offset, static_cast<uint32_t> (0)) };
+    start.key_frame_list = find_key_frames (time);
+    start.key_frame_list.erase (std::remove_if (start.key_frame_list.begin (), start.key_frame_list.end (), [&] (auto&& key_frame) { return !selection (key_frame.element_identifier); }), start.key_frame_list.end ());
+    if (start.key_frame_list.empty ())
+      return start;
+    const auto none = std::make_pair (std::numeric_limits<uint64_t>::max (), std::numeric_limits<uint32_t>::max ());
+    auto position = none;
+    for (auto&& key_frame : start.key_frame_list)
+      if (key_frame.time <= time)
+        position = std::min (position, key_frame.position);
+    if (position == none)
+      for (auto&& key_frame : start.key_frame_list)
+        position = std::min (position, key_frame.position);
+    start.position = position;
+    start.synchronized = false;
+    // NOTE: Compact records can only be read following the ones before them, without index there are no
+    //       synchronization points to seek to
+    start.scan = index.entry_map.empty () && (flags & AppsrcFile::g_compact_flag) != 0;
+    return start;
+  }
+  void seek_start (const Start& start)
+  {
+    if (start.scan)
+      skip_to (start.position);
+    else
+      seek (start.position.first, start.position.second, start.synchronized);
+  }
+  GstCaps* add_caps (uint16_t caps_identifier, const std::string& caps_string)
+  {
+    if (caps_list.size () <= caps_identifier)
+      caps_list.resize (caps_identifier + 1);
+    auto& caps = caps_list[caps_identifier];
+    if (!caps) {
+      caps = gst_caps_from_string (caps_string.c_str ());
+      caps_identifier_map.emplace (caps_string, caps_identifier);
+    }
+    return caps;
+  }
+  GstCaps* get_caps (uint16_t caps_identifier) const
+  {
+    return caps_identifier < caps_list.size () ? caps_list[caps_identifier] : nullptr;
+  }
+
+  bool next (Record& record)
+  {
+    for (;;) {
+      if (block_active && block_buffer.remaining () == 0)
+        block_active = false;
+      if (!block_active && (flags & AppsrcFile::g_checksum_flag)) {
+        if (std::exchange (checksum_pending, false))
+          this->stream.seekg (sizeof (uint32_t), std::ios_base::cur);
+        if (verify && mapping && !synchronize ())
+          return false;
+        checksum_pending = true;
+      }
+      auto& stream = block_active ? block_stream : this->stream;
+      uint8_t type;
+      if (!read (stream, type) || !read (stream, record.element_identifier))
+        return false;
+      record.type = type;
+      switch (type) {
+        case 1: {
+          std::string caps_string;
+          if (!read_caps_string (stream, caps_string))
+            return false;
+          // NOTE: Version 1 has no dictionary, identifiers are assigned in order of appearance
+          const auto iterator = caps_identifier_map.find (caps_string);
+          record.caps = iterator != caps_identifier_map.end () ? caps_list[iterator->second] : add_caps (static_cast<uint16_t> (caps_list.size ()), caps_string);
+          return true;
+        }
+        case AppsrcFile::g_caps_identifier: {
+          uint16_t caps_identifier;
+          if (!read (stream, caps_identifier))
+            return false;
+          record.type = 1;
+          record.caps = get_caps (caps_identifier);
+          if (!record.caps) {
+            GST_ERROR ("Undefined caps %u", caps_identifier);
+            return false;
+          }
+          return true;
+        }
+        case AppsrcFile::g_caps_definition_identifier: {
+          uint16_t caps_identifier;
+          std::string caps_string;
+          if (!read (stream, caps_identifier) || !read_caps_string (stream, caps_string))
+            return false;
+          add_caps (caps_identifier, caps_string);
+        } break;
+        case AppsrcFile::g_arrival_identifier: {
+          uint8_t data[10];
+          size_t size = 0;
+          uint64_t value;
+          const uint8_t* pointer = data;
+          if (!read_varint (stream, data, size) || !AppsrcFile::decode_varint (pointer, data + size, value))
+            return false;
+          pending_arrival = static_cast<GstClockTime> (value) * GST_USECOND;
+        } break;
+        case 2: {
+          uint32_t size;
+          record.arrival = std::exchange (pending_arrival, GST_CLOCK_TIME_NONE);
+          if (!read (stream, record.flags) || !read (stream, record.dts) || !read (stream, record.pts) || !read (stream, record.duration) || !read (stream, size))
+            return false;
+          skip_header_checksum (stream);
+          return read_payload (stream, record, size);
+        }
+        case AppsrcFile::g_compact_buffer_identifier: {
+          using CompactState = AppsrcFile::CompactState;
+          record.arrival = std::exchange (pending_arrival, GST_CLOCK_TIME_NONE);
+          const auto mask = static_cast<uint8_t> (stream.rdbuf ()->sbumpc ());
+          uint8_t data[CompactState::g_capacity + 10];
+          size_t size = 0;
+          for (auto field_mask : { CompactState::g_flags, CompactState::g_dts, CompactState::g_pts, CompactState::g_duration })
+            if ((mask & field_mask) && !read_varint (stream, data, size))
+              return false;
+          if (!read_varint (stream, data, size))
+            return false;
+          const uint8_t* pointer = data;
+          auto& state = compact_state_list[record.element_identifier];
+          uint64_t data_size;
+          if (!state.decode (mask, pointer, data + size) || !AppsrcFile::decode_varint (pointer, data + size, data_size)) {
+            GST_ERROR ("Invalid compact buffer record");
+            return false;
+          }
+          skip_header_checksum (stream);
+          auto& synchronized = synchronized_list[record.element_identifier];
+          if (mask & CompactState::g_sync)
+            synchronized = true;
+          if (!synchronized) {
+            stream.seekg (data_size, std::ios_base::cur);
+            break;
+          }
+          record.type = 2;
+          record.flags = state.flags;
+          record.dts = static_cast<int64_t> (state.dts);
+          record.pts = static_cast<int64_t> (state.pts);
+          record.duration = static_cast<int64_t> (state.duration);
+          return read_payload (stream, record, data_size);
+        }
+        case 3:
+          return true;
+        case AppsrcFile::g_index_identifier: {
+          uint64_t size;
+          if (!read (stream, size))
+            return false;
+          stream.seekg (size, std::ios_base::cur);
+        } break;
+        case AppsrcFile::g_footer_identifier:
+          stream.seekg (AppsrcFile::g_footer_size - 2, std::ios_base::cur);
+          break;
+        case AppsrcFile::g_block_identifier: {
+          if (block_active) {
+            GST_ERROR ("Nested block record");
+            return false;
+          }
+          const auto offset = static_cast<uint64_t> (stream.tellg ()) - 2;
+          uint8_t compression;
+          uint32_t size, compressed_size;
+          if (!read (stream, compression) || !read (stream, size) || !read (stream, compressed_size))
+            return false;
+          skip_header_checksum (stream);
+          stream.seekg (compressed_size, std::ios_base::cur);
+          if (!prefetch.get (offset, block_data)) {
+            GST_ERROR ("Failed to read block at offset %" G_GUINT64_FORMAT, offset);
+            return false;
+          }
+          block_buffer.set (block_data.data (), block_data.size ());
+          block_record_offset = offset;
+          block_stream.clear ();
+          if (pending_block_offset)
+            block_stream.seekg (std::exchange (pending_block_offset, 0));
+          block_active = true;
+        } break;
+        default:
+          GST_ERROR ("Unexpected record type %u", type);
+          return false;
+      }
+    }
+  }
+  void skip_header_checksum (std::istream& stream)
+  {
+    if (!block_active && (flags & AppsrcFile::g_checksum_flag))
+      stream.seekg (sizeof (uint32_t), std::ios_base::cur);
+  }
+  // NOTE: Size of the record at data up to its checksum, as far as its header tells; zero if the header is invalid
+  //       or the record does not fit into size. Header size is that of records with header checksum, zero otherwise
+  static uint64_t measure_record (const uint8_t* data, uint64_t size, uint64_t& header_size)
+  {
+    header_size = 0;
+    uint64_t position = 2;
+    const auto skip = [&] (uint64_t count) {
+      if (count > size - position)
+        return false;
+      position += count;
+      return true;
+    };
+    const auto get = [&] (auto& value) {
+      if (sizeof value > size - position)
+        return false;
+      memcpy (&value, data + position, sizeof value);
+      position += sizeof value;
+      return true;
+    };
+    const auto get_varint = [&] (uint64_t& value) {
+      auto pointer = data + position;
+      if (!AppsrcFile::decode_varint (pointer, data + size, value))
+        return false;
+      position = static_cast<uint64_t> (pointer - data);
+      return true;
+    };
+    const auto skip_header_checksum = [&] {
+      header_size = position;
+      return skip (sizeof (uint32_t));
+    };
+    if (size < position)
+      return 0;
+    const auto element_identifier = data[1];
+    bool valid = false;
+    switch (data[0]) {
+      case 2: {
+        uint32_t data_size;
+        valid = skip (4 * sizeof (uint64_t)) && get (data_size) && skip_header_checksum () && skip (data_size);
+      } break;
+      case 3:
+        valid = true;
+        break;
+      case AppsrcFile::g_index_identifier: {
+        uint64_t index_size;
+        valid = element_identifier == 0 && get (index_size) && skip (index_size);
+      } break;
+      case AppsrcFile::g_caps_definition_identifier: {
+        uint16_t caps_size;
+        valid = element_identifier == 0 && skip (sizeof (uint16_t)) && get (caps_size) && skip (caps_size);
+      } break;
+      case AppsrcFile::g_caps_identifier:
+        valid = skip (sizeof (uint16_t));
+        break;
+      case AppsrcFile::g_compact_buffer_identifier: {
+        using CompactState = AppsrcFile::CompactState;
+        uint8_t mask;
+        uint64_t value;
+        valid = get (mask);
+        for (auto field_mask : { CompactState::g_flags, CompactState::g_dts, CompactState::g_pts, CompactState::g_duration })
+          valid = valid && (!(mask & field_mask) || get_varint (value));
+        valid = valid && get_varint (value) && skip_header_checksum () && skip (value);
+      } break;
+      case AppsrcFile::g_block_identifier: {
+        uint8_t compression;
+        uint32_t block_size, compressed_size;
+        valid = element_identifier == 0 && get (compression) && compression <= static_cast<uint8_t> (AppsrcFile::Compression::Zstd) && get (block_size) && get (compressed_size) && (compression != static_cast<uint8_t> (AppsrcFile::Compression::None) || block_size == compressed_size) && skip_header_checksum () && skip (compressed_size);
+      } break;
+      case AppsrcFile::g_arrival_identifier: {
+        uint64_t value;
+        valid = get_varint (value);
+      } break;
+    }
+    return valid ? position : 0;
+  }
+  // NOTE: Checks the record at the read position against its checksum before it is parsed; past corrupt or
+  //       truncated data, moves on to where the next valid record starts (compact records wait for their stream to
+  //       reach a sync record again). False once there are no more records
+  bool synchronize ()
+  {
+    const auto is_valid = [&] (uint64_t offset) {
+      const auto data = mapping->data + offset;
+      const auto size = mapping->size - offset;
+      if (size == AppsrcFile::g_footer_size && data[0] == AppsrcFile::g_footer_identifier && memcmp (data + size - sizeof AppsrcFile::g_footer_magic, AppsrcFile::g_footer_magic, sizeof AppsrcFile::g_footer_magic) == 0)
+        return true;
+      uint64_t header_size;
+      const auto record_size = measure_record (data, size, header_size);
+      uint32_t checksum;
+      if (!record_size || sizeof checksum > size - record_size)
+        return false;
+      // NOTE: Random bytes taken for a header mostly claim a payload of megabytes, which is not looked at unless the
+      //       header checksum matches. Payloads stepped over are left unchecked as well, blocks are still decompressed
+      if (header_size) {
+        memcpy (&checksum, data + header_size, sizeof checksum);
+        if (AppsrcFile::Crc32c::update (0, data, header_size) != checksum)
+          return false;
+        if (skip_payload && !verify_skipped && data[0] != AppsrcFile::g_block_identifier)
+          return true;
+      }
+      memcpy (&checksum, data + record_size, sizeof checksum);
+      return AppsrcFile::Crc32c::update (0, data, record_size) == checksum;
+    };
+    const auto start_offset = static_cast<uint64_t> (stream.tellg ());
+    auto offset = start_offset;
+    while (offset < mapping->size && !is_valid (offset))
+      offset++;
+    if (offset != start_offset) {
+      GST_WARNING ("Skipped %" G_GUINT64_FORMAT " bytes of corrupt data at offset %" G_GUINT64_FORMAT, offset - start_offset, start_offset);
+      corrupt_count++;
+      corrupt_size += offset - start_offset;
+      stream.seekg (offset);
+      pending_arrival = GST_CLOCK_TIME_NONE;
+      std::fill (std::begin (synchronized_list), std::end (synchronized_list), false);
+    }
+    return offset < mapping->size;
+  }
+  bool read_payload (std::istream& stream, Record& record, uint64_t size)
+  {
+    if (record.buffer)
+      gst_buffer_unref (std::exchange (record.buffer, nullptr));
+    record.size = size;
+    const auto offset = static_cast<uint64_t> (stream.tellg ());
+    record.offset = block_active ? 0 : offset;
+    // NOTE: Sizes read from a corrupt or truncated file are not to be trusted with an allocation
+    const auto limit = block_active ? static_cast<uint64_t> (block_data.size ()) : file_size;
+    if (offset > limit || size > limit - offset) {
+      GST_ERROR ("Truncated record, payload of %" G_GUINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT, size, offset);
+      return false;
+    }
+    if (skip_payload) {
+      record.data.clear ();
+      record.mapped_data = nullptr;
+      stream.seekg (size, std::ios_base::cur);
+      return !stream.fail ();
+    }
+    if (mapping && !block_active && size) {
+      record.data.clear ();
+      record.mapped_data = mapping->data + offset;
+      record.mapped_size = static_cast<size_t> (size);
+      stream.seekg (size, std::ios_base::cur);
+      return true;
+    }
+    record.mapped_data = nullptr;
+    if (pool && size) {
+      uint8_t* data;
+      record.data.clear ();
+      record.buffer = pool->acquire (static_cast<size_t> (size), data);
+      stream.read (reinterpret_cast<char*> (data), static_cast<std::streamsize> (size));
+      return !stream.fail ();
+    }
+    record.data.resize (size);
+    stream.read (reinterpret_cast<char*> (record.data.data ()), record.data.size ());
+    return !stream.fail ();
+  }
+
+  std::filebuf file_buffer;
+  Mapping* mapping = nullptr;
+  PayloadPool* pool = nullptr; // Payloads which are not mapped are read into buffers of the pool
+  MemoryBuffer mapped_buffer;
+  std::istream stream { &file_buffer };
+  uint16_t version = 1;
+  uint16_t flags = 0;
+  uint64_t data_offset = 0;
+  std::vector<std::pair<uint8_t, uint16_t>> stream_table;
+  std::vector<GstCaps*> caps_list;
+  std::map<std::string, uint16_t> caps_identifier_map;
+  Index index;
+  AppsrcFile::CompactState compact_state_list[256];
+  bool synchronized_list[256] {};
+  BlockPrefetch prefetch;
+  std::vector<uint8_t> block_data;
+  MemoryBuffer block_buffer;
+  std::istream block_stream { &block_buffer };
+  bool block_active = false;
+  uint64_t block_record_offset = 0;
+  uint32_t pending_block_offset = 0;
+  bool skip_payload = false; // Buffer records come without payload
+  bool verify_skipped = false; // Payloads stepped over are verified as well; otherwise only the record headers are
+  GstClockTime pending_arrival = GST_CLOCK_TIME_NONE;
+  uint64_t file_size = 0;
+  bool verify = true; // Verify records of files with checksums, set before open; otherwise checksums are stepped over
+  bool checksum_pending = false; // Checksum of the last record outside of blocks is yet to be stepped over
+  uint64_t corrupt_count = 0; // Corrupt or truncated ranges skipped over
+  uint64_t corrupt_size = 0;
+};
+
+// NOTE: Names of buffer flags as printed in replay logs and inspection reports
+inline const std::initializer_list<std::pair<guint, const char*>>& get_buffer_flag_list ()
+{
+  static const std::initializer_list<std::pair<guint, const char*>> g_list { // clang-format off
+    #define IDENTIFIER(Name) std::make_pair<guint, const char*>(Name, #Name),
+    IDENTIFIER (GST_BUFFER_FLAG_LIVE)
+    IDENTIFIER (GST_BUFFER_FLAG_DECODE_ONLY)
+    IDENTIFIER (GST_BUFFER_FLAG_DISCONT)
+    IDENTIFIER (GST_BUFFER_FLAG_RESYNC)
+    IDENTIFIER (GST_BUFFER_FLAG_CORRUPTED)
+    IDENTIFIER (GST_BUFFER_FLAG_MARKER)
+    IDENTIFIER (GST_BUFFER_FLAG_HEADER)
+    IDENTIFIER (GST_BUFFER_FLAG_GAP)
+    IDENTIFIER (GST_BUFFER_FLAG_DROPPABLE)
+    IDENTIFIER (GST_BUFFER_FLAG_DELTA_UNIT)
+    IDENTIFIER (GST_BUFFER_FLAG_TAG_MEMORY)
+    IDENTIFIER (GST_BUFFER_FLAG_SYNC_AFTER)
+    IDENTIFIER (GST_BUFFER_FLAG_NON_DROPPABLE)
+    #undef IDENTIFIER
+  }; // clang-format on
+  return g_list;
+}
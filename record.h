@@ -1,21 +1,935 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <utility>
+#include <limits>
+#include <map>
+#include <tuple>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <array>
+#include <fcntl.h>
+#if defined(WITH_LZ4)
+#  include <lz4.h>
+#endif
+#if defined(WITH_ZSTD)
+#  include <zstd.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#  define CRC32C_HARDWARE
+#  include <nmmintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#  if defined(__GNUC__)
+#    define CRC32C_TARGET __attribute__ ((target ("sse4.2")))
+#  endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#  define CRC32C_HARDWARE
+#  include <arm_acle.h>
+#endif
+#if !defined(CRC32C_TARGET)
+#  define CRC32C_TARGET
+#endif
+#if defined(WIN32)
+#  include <io.h>
+#  include <sys/stat.h>
+#else
+#  include <unistd.h>
+#  include <limits.h>
+#  include <sys/uio.h>
+#  if defined(__linux__)
+#    include <sys/sendfile.h>
+#  endif
+#endif
 
 struct AppsrcFile {
+  // NOTE: Output is a plain file descriptor with a staging area for record headers and short payloads; large
+  //       payloads are not copied, their GstMemory blocks are mapped and handed over to writev along with staged
+  //       bytes on next flush
+  struct Output {
+#if defined(WIN32)
+    struct Vector {
+      const void* iov_base;
+      size_t iov_len;
+    };
+    static size_t constexpr const g_vector_capacity = 1024;
+#else
+    using Vector = struct iovec;
+    static size_t constexpr const g_vector_capacity = IOV_MAX;
+#endif
+    static size_t constexpr const g_staging_capacity = 256 << 10;
+    static size_t constexpr const g_attached_capacity = 8 << 20;
+    static size_t constexpr const g_direct_size = 4 << 10; // Payloads below this size are staged (copied)
+
+    bool open (const char* path)
+    {
+      g_assert_true (descriptor < 0);
+#if defined(WIN32)
+      descriptor = _open (path, _O_BINARY | _O_WRONLY | _O_CREAT | _O_TRUNC, _S_IREAD | _S_IWRITE);
+#else
+      descriptor = ::open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+      staging.reserve (g_staging_capacity);
+      position = 0;
+      failed = false;
+      return descriptor >= 0;
+    }
+    void close ()
+    {
+      if (descriptor < 0)
+        return;
+      flush ();
+#if defined(WIN32)
+      _close (descriptor);
+#else
+      ::close (descriptor);
+#endif
+      descriptor = -1;
+    }
+    void stage (const void* data, size_t data_size)
+    {
+      if (staging.size () + data_size > g_staging_capacity || segment_list.size () + 1 > g_vector_capacity)
+        flush ();
+      if (data_size > g_staging_capacity) {
+        write_vector ({ Segment { nullptr, data, data_size } });
+        position += data_size;
+        return;
+      }
+      // NOTE: Staging never reallocates (capacity is reserved and flushed before overflow), so segments can keep data pointers
+      const auto bytes = reinterpret_cast<const uint8_t*> (data);
+      const auto end = staging.data () + staging.size ();
+      if (!segment_list.empty () && !segment_list.back ().memory && reinterpret_cast<const uint8_t*> (segment_list.back ().data) + segment_list.back ().size == end)
+        segment_list.back ().size += data_size;
+      else
+        segment_list.push_back ({ nullptr, end, data_size });
+      staging.insert (staging.end (), bytes, bytes + data_size);
+      position += data_size;
+    }
+    // NOTE: Takes over the mapping of the memory block and keeps a reference to it until the next flush
+    void attach (GstMemory* memory, const GstMapInfo& map_info)
+    {
+      if (segment_list.size () + 1 > g_vector_capacity || attached_size + map_info.size > g_attached_capacity)
+        flush ();
+      gst_memory_ref (memory);
+      map_info_list.push_back (map_info);
+      segment_list.push_back ({ memory, map_info.data, map_info.size });
+      attached_size += map_info.size;
+      position += map_info.size;
+    }
+    void flush ()
+    {
+      write_vector ({});
+    }
+    // NOTE: Appends a byte range of another file, copied by the kernel (copy_file_range, or sendfile where it does
+    //       not apply, e.g. across file systems on older kernels) without passing through user space; whatever the
+    //       kernel does not copy is read and written
+    bool copy (int source_descriptor, uint64_t offset, uint64_t size)
+    {
+      flush ();
+      position += size;
+      const auto end = offset + size;
+#if defined(__linux__)
+      for (bool range = true; offset < end;) {
+        const auto count = static_cast<size_t> (std::min<uint64_t> (end - offset, 1u << 30));
+        loff_t range_offset = static_cast<loff_t> (offset);
+        off_t file_offset = static_cast<off_t> (offset);
+        const auto result = range ? ::copy_file_range (source_descriptor, &range_offset, descriptor, nullptr, count, 0) : ::sendfile (descriptor, source_descriptor, &file_offset, count);
+        if (result < 0 && errno == EINTR)
+          continue;
+        if (result < 0 && range && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+          range = false;
+          continue;
+        }
+        if (result <= 0)
+          break;
+        offset += static_cast<uint64_t> (result);
+      }
+#endif
+      std::vector<uint8_t> data;
+      while (offset < end) {
+        data.resize (static_cast<size_t> (std::min<uint64_t> (end - offset, g_staging_capacity)));
+#if defined(WIN32)
+        const auto result = _lseeki64 (source_descriptor, static_cast<__int64> (offset), SEEK_SET) < 0 ? -1 : _read (source_descriptor, data.data (), static_cast<unsigned int> (data.size ()));
+#else
+        const auto result = ::pread (source_descriptor, data.data (), data.size (), static_cast<off_t> (offset));
+        if (result < 0 && errno == EINTR)
+          continue;
+#endif
+        if (result <= 0)
+          break;
+        write_vector ({ Segment { nullptr, data.data (), static_cast<size_t> (result) } });
+        offset += static_cast<uint64_t> (result);
+      }
+      return offset == end;
+    }
+
+    int descriptor = -1;
+    std::vector<uint8_t> staging;
+    size_t attached_size = 0;
+    uint64_t position = 0; // File offset of next written byte
+    bool failed = false; // Writing failed, the file is incomplete from then on
+
+  private:
+    struct Segment {
+      GstMemory* memory;
+      const void* data;
+      size_t size;
+    };
+
+    void write_vector (std::initializer_list<Segment> extra_segment_list)
+    {
+      vector_list.clear ();
+      for (auto&& segment : segment_list)
+        vector_list.push_back ({ const_cast<void*> (segment.data), segment.size });
+      for (auto&& segment : extra_segment_list)
+        vector_list.push_back ({ const_cast<void*> (segment.data), segment.size });
+      if (!vector_list.empty () && descriptor >= 0)
+        write_vector_list ();
+      for (auto&& map_info : map_info_list) {
+        const auto memory = map_info.memory;
+        gst_memory_unmap (memory, &map_info);
+        gst_memory_unref (memory);
+      }
+      map_info_list.clear ();
+      segment_list.clear ();
+      staging.clear ();
+      attached_size = 0;
+    }
+    void write_vector_list ()
+    {
+#if defined(WIN32)
+      for (auto&& element : vector_list)
+        for (auto data = reinterpret_cast<const char*> (element.iov_base), end = data + element.iov_len; data < end;) {
+          const auto result = _write (descriptor, data, static_cast<unsigned int> (std::min<size_t> (end - data, 1u << 30)));
+          if (result <= 0) {
+            fail ();
+            return;
+          }
+          data += result;
+        }
+#else
+      auto iterator = vector_list.begin ();
+      while (iterator != vector_list.end ()) {
+        const auto count = static_cast<int> (std::min<size_t> (vector_list.end () - iterator, IOV_MAX));
+        const auto result = ::writev (descriptor, &*iterator, count);
+        if (result < 0) {
+          if (errno == EINTR)
+            continue;
+          fail ();
+          return;
+        }
+        // NOTE: Partial write, advance over what is already in the file
+        for (auto written = static_cast<size_t> (result); iterator != vector_list.end () && written;) {
+          if (written < iterator->iov_len) {
+            iterator->iov_base = reinterpret_cast<uint8_t*> (iterator->iov_base) + written;
+            iterator->iov_len -= written;
+            break;
+          }
+          written -= iterator->iov_len;
+          iterator++;
+        }
+      }
+#endif
+    }
+    // NOTE: Reported once, later writes are still attempted (e.g. space may be freed up) but the file is broken
+    void fail ()
+    {
+      if (!std::exchange (failed, true))
+        GST_ERROR ("Failed to write to file at offset %" G_GUINT64_FORMAT ": %s", position, g_strerror (errno));
+    }
+
+    std::vector<Segment> segment_list;
+    std::vector<GstMapInfo> map_info_list;
+    std::vector<Vector> vector_list;
+  };
+
+  // NOTE: Asynchronous mode only, what handle_buffer does when queued data reaches queue_capacity:
+  //       Block - waits for the writer thread to free up space
+  //       Drop - discards the buffer
+  //       CountAndDrop - discards the buffer, updates drop counters and flags next written buffer of the stream with
+  //         GST_BUFFER_FLAG_DISCONT, so that the gap is visible on replay
+  //       Once a buffer is dropped, delta units of the same stream are dropped as well until next key frame
+  enum class OverflowPolicy {
+    Block,
+    Drop,
+    CountAndDrop,
+  };
+
+  // NOTE: File starts with a header (files of version 1 have no header and start with records right away):
+  //       g_header_magic, uint16_t version, uint16_t flags, uint32_t size, stream table of uint8_t count and
+  //       (uint8_t element identifier, uint16_t caps identifier) pairs, caps dictionary of uint16_t count and
+  //       (uint16_t size, caps string) pairs; identifier of caps is its position in the dictionary
+  //       Readers are expected to reject files of newer version or with flags they do not know
+  static constexpr const char g_header_magic[8] { 'A', 'p', 'p', 's', 'r', 'c', 'R', 'f' };
+  static uint16_t constexpr const g_version = 2;
+  static uint16_t constexpr const g_compact_flag = 0x0001; // Buffers are written as compact records
+  static uint16_t constexpr const g_lz4_flag = 0x0002; // Records are packed into LZ4 compressed blocks
+  static uint16_t constexpr const g_zstd_flag = 0x0004; // Records are packed into Zstandard compressed blocks
+  static uint16_t constexpr const g_arrival_flag = 0x0008; // Buffer records are preceded by arrival records
+  static uint16_t constexpr const g_checksum_flag = 0x0010; // Records outside of blocks are followed by uint32_t CRC32C of the record, except for the footer
+  static uint16_t constexpr const g_supported_flags = g_compact_flag | g_arrival_flag | g_checksum_flag
+#if defined(WITH_LZ4)
+      | g_lz4_flag
+#endif
+#if defined(WITH_ZSTD)
+      | g_zstd_flag
+#endif
+      ;
+  static uint16_t constexpr const g_no_caps_identifier = 0xFFFF;
+
+  // NOTE: Record types, each record starts with type and element identifier bytes
+  //       1 - caps (version 1): uint16_t size, caps string
+  //       2 - buffer: uint64_t flags, int64_t dts, pts, duration, uint32_t size, payload
+  //       3 - end of stream
+  //       4 - index (element identifier 0): uint64_t size, sections of uint8_t tag, uint64_t size, data
+  //       5 - footer (element identifier 0): uint64_t index record offset, g_footer_magic; always the last 18 bytes
+  //       6 - caps definition (element identifier 0): uint16_t caps identifier, uint16_t size, caps string; adds
+  //           caps to the dictionary which were not known at the time of writing the header
+  //       7 - caps: uint16_t caps identifier
+  //       8 - compact buffer: uint8_t mask, fields selected by mask (see CompactState), varint size, payload
+  //       9 - block (element identifier 0): uint8_t compression, uint32_t size, uint32_t compressed size, compressed
+  //           data; the data is a sequence of records of other types, blocks compress independently of each other.
+  //           Blocks which failed to compress are stored as is with compression 0 (none)
+  //       10 - arrival: varint microseconds since start of recording at which the following buffer record of the
+  //            stream was handed over
+  //       Varints are LEB128, signed values are zigzag encoded
+  //       With g_checksum_flag every record outside of blocks but the footer is followed by uint32_t CRC32C of its
+  //       bytes (type byte through payload), records within a block are covered by the checksum of the block record.
+  //       Buffer, compact buffer and block records outside of blocks also carry uint32_t CRC32C of their header
+  //       between header and payload, so that readers skipping corrupt data reject the payload sizes random bytes
+  //       claim without checksumming that much data
+  static uint8_t constexpr const g_index_identifier = 4;
+  static uint8_t constexpr const g_footer_identifier = 5;
+  static uint8_t constexpr const g_caps_definition_identifier = 6;
+  static uint8_t constexpr const g_caps_identifier = 7;
+  static uint8_t constexpr const g_compact_buffer_identifier = 8;
+  static uint8_t constexpr const g_block_identifier = 9;
+  static uint8_t constexpr const g_arrival_identifier = 10;
+  static size_t constexpr const g_block_header_size = 2 + 1 + 4 + 4;
+  static uint8_t constexpr const g_index_key_frame_section = 1;
+  static uint8_t constexpr const g_index_caps_section = 2; // Complete caps dictionary in header format
+  static uint8_t constexpr const g_index_block_key_frame_section = 3; // Key frame entries followed by uint32_t block offsets of the record and of the caps record
+  static uint8_t constexpr const g_index_block_section = 4; // uint64_t offset, uint32_t size, uint32_t compressed size of every block
+  static constexpr const char g_footer_magic[8] { 'A', 'p', 'p', 's', 'r', 'c', 'I', 'x' };
+  static size_t constexpr const g_footer_size = 2 + sizeof (uint64_t) + sizeof g_footer_magic;
+
+  // NOTE: Key frame section of the index, entries are in file order and so are sorted by time within each stream
+  struct IndexEntry {
+    static size_t constexpr const g_size = 1 + 8 + 8 + 8 + 8;
+
+    GstClockTime time () const
+    {
+      return static_cast<GstClockTime> (GST_CLOCK_TIME_IS_VALID (static_cast<GstClockTime> (dts)) ? dts : pts);
+    }
+
+    uint8_t element_identifier;
+    uint64_t offset; // Buffer record, or block record containing it
+    uint64_t caps_offset; // Most recent caps record of the stream (or its block), or UINT64_MAX
+    int64_t dts;
+    int64_t pts;
+    uint32_t block_offset = 0; // Offset of the record within uncompressed block
+    uint32_t caps_block_offset = 0;
+  };
+  struct BlockEntry {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t compressed_size;
+  };
+
+  enum class Compression : uint8_t {
+    None,
+    Lz4,
+    Zstd,
+  };
+
+  // NOTE: CRC32C (Castagnoli) of record checksums, chained like zlib crc32: the result of a previous call continues
+  //       over more data, zero to start; CRC instructions of SSE 4.2 or ARMv8 where available, slicing-by-8 tables
+  //       otherwise. Large inputs run three independent instruction streams over adjacent chunks to hide latency of
+  //       the instruction and combine their results by shifting through precomputed tables (as in Mark Adler's
+  //       crc32c.c), which brings it close to memory bandwidth
+  struct Crc32c {
+    static uint32_t constexpr const g_polynomial = 0x82F63B78; // Reflected
+    static size_t constexpr const g_long_size = 8192;
+    static size_t constexpr const g_short_size = 256;
+
+    static uint32_t update (uint32_t crc, const void* data, size_t size)
+    {
+      const auto bytes = reinterpret_cast<const uint8_t*> (data);
+#if defined(CRC32C_HARDWARE)
+      static const auto g_hardware = is_hardware_supported ();
+      if (g_hardware)
+        return ~update_hardware (~crc, bytes, size);
+#endif
+      return ~update_software (~crc, bytes, size);
+    }
+
+  private:
+    struct Table {
+      Table ()
+      {
+        for (uint32_t index = 0; index < 256; index++) {
+          auto value = index;
+          for (int bit = 0; bit < 8; bit++)
+            value = (value >> 1) ^ (g_polynomial & (0u - (value & 1)));
+          slice[0][index] = value;
+        }
+        for (uint32_t index = 0; index < 256; index++)
+          for (size_t slice_index = 1; slice_index < slice.size (); slice_index++)
+            slice[slice_index][index] = (slice[slice_index - 1][index] >> 8) ^ slice[0][slice[slice_index - 1][index] & 0xFF];
+        build_shift (long_shift, g_long_size);
+        build_shift (short_shift, g_short_size);
+      }
+
+      using Matrix = std::array<uint32_t, 32>; // Linear operator on CRC values over GF(2), one column per bit
+      using Shift = std::array<std::array<uint32_t, 256>, 4>;
+
+      static uint32_t multiply (const Matrix& matrix, uint32_t value)
+      {
+        uint32_t result = 0;
+        for (size_t index = 0; value; value >>= 1, index++)
+          if (value & 1)
+            result ^= matrix[index];
+        return result;
+      }
+      static Matrix square (const Matrix& matrix)
+      {
+        Matrix result;
+        for (size_t index = 0; index < result.size (); index++)
+          result[index] = multiply (matrix, matrix[index]);
+        return result;
+      }
+      // NOTE: Operator appending size zero bytes (a power of two) to the data of a CRC, split into per-byte tables
+      static void build_shift (Shift& shift, size_t size)
+      {
+        Matrix matrix; // One zero bit
+        matrix[0] = g_polynomial;
+        for (size_t index = 1; index < matrix.size (); index++)
+          matrix[index] = 1u << (index - 1);
+        for (size_t bit_count = 1; bit_count < size * 8; bit_count <<= 1)
+          matrix = square (matrix);
+        for (uint32_t index = 0; index < 256; index++)
+          for (size_t byte = 0; byte < shift.size (); byte++)
+            shift[byte][index] = multiply (matrix, index << (byte * 8));
+      }
+
+      std::array<std::array<uint32_t, 256>, 8> slice;
+      Shift long_shift;
+      Shift short_shift;
+    };
+
+    static const Table& get_table ()
+    {
+      static const Table g_table;
+      return g_table;
+    }
+    static uint32_t shift (const Table::Shift& shift, uint32_t crc)
+    {
+      return shift[0][crc & 0xFF] ^ shift[1][(crc >> 8) & 0xFF] ^ shift[2][(crc >> 16) & 0xFF] ^ shift[3][crc >> 24];
+    }
+#if defined(CRC32C_HARDWARE)
+    static bool is_hardware_supported ()
+    {
+#  if defined(_MSC_VER)
+      int information[4];
+      __cpuid (information, 1);
+      return (information[2] & (1 << 20)) != 0;
+#  elif defined(__x86_64__)
+      return __builtin_cpu_supports ("sse4.2");
+#  else
+      return true;
+#  endif
+    }
+#endif
+    static uint32_t update_software (uint32_t crc, const uint8_t* data, size_t size)
+    {
+      const auto& slice = get_table ().slice;
+      for (; size >= 8; size -= 8, data += 8) {
+        uint64_t value;
+        memcpy (&value, data, sizeof value);
+        value ^= crc;
+        crc = slice[7][value & 0xFF] ^ slice[6][(value >> 8) & 0xFF] ^ slice[5][(value >> 16) & 0xFF] ^ slice[4][(value >> 24) & 0xFF] ^ slice[3][(value >> 32) & 0xFF] ^ slice[2][(value >> 40) & 0xFF] ^ slice[1][(value >> 48) & 0xFF] ^ slice[0][value >> 56];
+      }
+      for (; size; size--)
+        crc = (crc >> 8) ^ slice[0][(crc ^ *data++) & 0xFF];
+      return crc;
+    }
+#if defined(__x86_64__) || defined(_M_X64)
+    CRC32C_TARGET static uint32_t update_byte (uint32_t crc, uint8_t value) { return _mm_crc32_u8 (crc, value); }
+    CRC32C_TARGET static uint64_t update_word (uint64_t crc, uint64_t value) { return _mm_crc32_u64 (crc, value); }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    static uint32_t update_byte (uint32_t crc, uint8_t value) { return __crc32cb (crc, value); }
+    static uint64_t update_word (uint64_t crc, uint64_t value) { return __crc32cd (static_cast<uint32_t> (crc), value); }
+#endif
+#if defined(CRC32C_HARDWARE)
+    static uint64_t load (const uint8_t* data)
+    {
+      uint64_t value;
+      memcpy (&value, data, sizeof value);
+      return value;
+    }
+    // NOTE: Three chunks of the given size at a time, each by its own chain of instructions
+    template<size_t t_size>
+    CRC32C_TARGET static void update_interleaved (uint64_t& crc, const uint8_t*& data, size_t& size, const Table::Shift& chunk_shift)
+    {
+      for (; size >= 3 * t_size; data += 3 * t_size, size -= 3 * t_size) {
+        uint64_t crc1 = 0, crc2 = 0;
+        for (size_t offset = 0; offset < t_size; offset += 8) {
+          crc = update_word (crc, load (data + offset));
+          crc1 = update_word (crc1, load (data + t_size + offset));
+          crc2 = update_word (crc2, load (data + 2 * t_size + offset));
+        }
+        crc = shift (chunk_shift, static_cast<uint32_t> (crc)) ^ static_cast<uint32_t> (crc1);
+        crc = shift (chunk_shift, static_cast<uint32_t> (crc)) ^ static_cast<uint32_t> (crc2);
+      }
+    }
+    CRC32C_TARGET static uint32_t update_hardware (uint32_t crc, const uint8_t* data, size_t size)
+    {
+      uint64_t value = crc;
+      for (; size && (reinterpret_cast<uintptr_t> (data) & 7) != 0; size--)
+        value = update_byte (static_cast<uint32_t> (value), *data++);
+      if (size >= 3 * g_short_size) {
+        const auto& table = get_table ();
+        update_interleaved<g_long_size> (value, data, size, table.long_shift);
+        update_interleaved<g_short_size> (value, data, size, table.short_shift);
+      }
+      for (; size >= 8; size -= 8, data += 8)
+        value = update_word (value, load (data));
+      for (; size; size--)
+        value = update_byte (static_cast<uint32_t> (value), *data++);
+      return static_cast<uint32_t> (value);
+    }
+#endif
+  };
+
+  static bool decompress_block (uint8_t compression, const uint8_t* data, size_t data_size, uint8_t* output_data, size_t output_size)
+  {
+    switch (static_cast<Compression> (compression)) {
+      case Compression::None:
+        if (data_size != output_size)
+          return false;
+        std::memcpy (output_data, data, data_size);
+        return true;
+#if defined(WITH_LZ4)
+      case Compression::Lz4:
+        return LZ4_decompress_safe (reinterpret_cast<const char*> (data), reinterpret_cast<char*> (output_data), static_cast<int> (data_size), static_cast<int> (output_size)) == static_cast<int> (output_size);
+#endif
+#if defined(WITH_ZSTD)
+      case Compression::Zstd: {
+        const auto result = ZSTD_decompress (output_data, output_size, data, data_size);
+        return !ZSTD_isError (result) && result == output_size;
+      }
+#endif
+      default:
+        break;
+    }
+    return false;
+  }
+  static bool is_supported (Compression compression)
+  {
+    switch (compression) {
+      case Compression::None:
+#if defined(WITH_LZ4)
+      case Compression::Lz4:
+#endif
+#if defined(WITH_ZSTD)
+      case Compression::Zstd:
+#endif
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  static size_t encode_varint (uint8_t* data, uint64_t value)
+  {
+    size_t size = 0;
+    for (; value >= 0x80; value >>= 7)
+      data[size++] = static_cast<uint8_t> (value | 0x80);
+    data[size++] = static_cast<uint8_t> (value);
+    return size;
+  }
+  static bool decode_varint (const uint8_t*& data, const uint8_t* end, uint64_t& value)
+  {
+    value = 0;
+    for (unsigned int shift = 0; data < end && shift < 64; shift += 7) {
+      const auto byte = *data++;
+      value |= static_cast<uint64_t> (byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+  static uint64_t zigzag_encode (int64_t value)
+  {
+    return (static_cast<uint64_t> (value) << 1) ^ static_cast<uint64_t> (value >> 63);
+  }
+  static int64_t zigzag_decode (uint64_t value)
+  {
+    return static_cast<int64_t> (value >> 1) ^ -static_cast<int64_t> (value & 1);
+  }
+
+  // NOTE: Per-stream state of compact buffer records, shared by writer and reader; values which match the prediction
+  //       from the previous buffer of the stream are omitted:
+  //       flags - same as previous
+  //       dts - previous dts + previous duration
+  //       pts - dts + previous (pts - dts), or previous pts + previous duration without dts
+  //       duration - same as previous
+  //       Sync records reset the state first, they are written for indexed buffers so that replay can start there
+  struct CompactState {
+    static uint8_t constexpr const g_flags = 0x01; // varint flags follow
+    static uint8_t constexpr const g_dts_none = 0x02;
+    static uint8_t constexpr const g_dts = 0x04; // zigzag varint difference to predicted dts follows
+    static uint8_t constexpr const g_pts_none = 0x08;
+    static uint8_t constexpr const g_pts = 0x10; // zigzag varint difference to predicted pts follows
+    static uint8_t constexpr const g_duration_none = 0x20;
+    static uint8_t constexpr const g_duration = 0x40; // varint duration follows
+    static uint8_t constexpr const g_sync = 0x80;
+    static size_t constexpr const g_capacity = 3 + 10 * 4; // Header of the record up to size
+
+    GstClockTime predict_dts () const
+    {
+      if (!GST_CLOCK_TIME_IS_VALID (dts))
+        return GST_CLOCK_TIME_NONE;
+      return GST_CLOCK_TIME_IS_VALID (duration) ? dts + duration : dts;
+    }
+    GstClockTime predict_pts (GstClockTime current_dts) const
+    {
+      if (!GST_CLOCK_TIME_IS_VALID (pts))
+        return GST_CLOCK_TIME_NONE;
+      if (GST_CLOCK_TIME_IS_VALID (current_dts) && GST_CLOCK_TIME_IS_VALID (dts))
+        return current_dts + (pts - dts);
+      return GST_CLOCK_TIME_IS_VALID (duration) ? pts + duration : pts;
+    }
+    // NOTE: Writes record header up to (not including) payload size
+    size_t encode (uint8_t* data, uint8_t element_identifier, uint64_t current_flags, GstClockTime current_dts, GstClockTime current_pts, GstClockTime current_duration, bool sync)
+    {
+      if (sync)
+        *this = CompactState ();
+      size_t size = 0;
+      data[size++] = g_compact_buffer_identifier;
+      data[size++] = element_identifier;
+      auto& mask = data[size++];
+      mask = sync ? g_sync : 0;
+      if (current_flags != flags) {
+        mask |= g_flags;
+        size += encode_varint (data + size, current_flags);
+      }
+      const auto encode_time = [&] (GstClockTime value, GstClockTime predicted_value, uint8_t none_mask, uint8_t value_mask) {
+        if (value == predicted_value)
+          return;
+        if (!GST_CLOCK_TIME_IS_VALID (value)) {
+          mask |= none_mask;
+          return;
+        }
+        mask |= value_mask;
+        const auto base_value = GST_CLOCK_TIME_IS_VALID (predicted_value) ? predicted_value : 0;
+        size += encode_varint (data + size, zigzag_encode (static_cast<int64_t> (value - base_value)));
+      };
+      encode_time (current_dts, predict_dts (), g_dts_none, g_dts);
+      encode_time (current_pts, predict_pts (current_dts), g_pts_none, g_pts);
+      if (current_duration != duration) {
+        if (GST_CLOCK_TIME_IS_VALID (current_duration)) {
+          mask |= g_duration;
+          size += encode_varint (data + size, current_duration);
+        } else
+          mask |= g_duration_none;
+      }
+      flags = current_flags;
+      dts = current_dts;
+      pts = current_pts;
+      duration = current_duration;
+      return size;
+    }
+    // NOTE: Reads fields following the mask byte
+    bool decode (uint8_t mask, const uint8_t*& data, const uint8_t* end)
+    {
+      if (mask & g_sync)
+        *this = CompactState ();
+      if ((mask & g_flags) && !decode_varint (data, end, flags))
+        return false;
+      const auto decode_time = [&] (GstClockTime& value, GstClockTime predicted_value, uint8_t none_mask, uint8_t value_mask) {
+        if (mask & none_mask) {
+          value = GST_CLOCK_TIME_NONE;
+          return true;
+        }
+        if (!(mask & value_mask)) {
+          value = predicted_value;
+          return true;
+        }
+        uint64_t difference;
+        if (!decode_varint (data, end, difference))
+          return false;
+        value = (GST_CLOCK_TIME_IS_VALID (predicted_value) ? predicted_value : 0) + static_cast<GstClockTime> (zigzag_decode (difference));
+        return true;
+      };
+      GstClockTime current_dts, current_pts;
+      if (!decode_time (current_dts, predict_dts (), g_dts_none, g_dts) || !decode_time (current_pts, predict_pts (current_dts), g_pts_none, g_pts))
+        return false;
+      dts = current_dts;
+      pts = current_pts;
+      if (mask & g_duration_none)
+        duration = GST_CLOCK_TIME_NONE;
+      else if ((mask & g_duration) && !decode_varint (data, end, duration))
+        return false;
+      return true;
+    }
+
+    uint64_t flags = 0;
+    GstClockTime dts = GST_CLOCK_TIME_NONE;
+    GstClockTime pts = GST_CLOCK_TIME_NONE;
+    GstClockTime duration = GST_CLOCK_TIME_NONE;
+  };
+
+  struct Entry {
+    uint8_t type;
+    uint8_t element_identifier;
+    GstCaps* caps;
+    GstBuffer* buffer;
+    size_t size;
+    guint flags; // Extra buffer flags to write
+    gint64 time = 0; // Monotonic time of handing over the buffer (or of staging in concurrent mode), in microseconds
+  };
+
+  // NOTE: Concurrent mode only, single producer single consumer ring of entries of one stream; the producer is the
+  //       thread which pushes the stream, the consumer is the merger thread
+  struct StagingQueue {
+    explicit StagingQueue (size_t capacity) :
+      entry_list (capacity)
+    {
+      g_assert_true (capacity && !(capacity & (capacity - 1)));
+    }
+
+    bool push (const Entry& entry)
+    {
+      const auto tail_value = tail.load (std::memory_order_relaxed);
+      if (tail_value - head.load (std::memory_order_acquire) == entry_list.size ())
+        return false;
+      entry_list[tail_value & (entry_list.size () - 1)] = entry;
+      tail.store (tail_value + 1, std::memory_order_release);
+      return true;
+    }
+    Entry* front ()
+    {
+      const auto head_value = head.load (std::memory_order_relaxed);
+      if (head_value == tail.load (std::memory_order_acquire))
+        return nullptr;
+      return &entry_list[head_value & (entry_list.size () - 1)];
+    }
+    void pop ()
+    {
+      head.store (head.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::vector<Entry> entry_list;
+    alignas (64) std::atomic<uint64_t> head = 0;
+    alignas (64) std::atomic<uint64_t> tail = 0;
+    bool active = false; // Merger only, stream has entries written and has not ended
+  };
+
+  ~AppsrcFile ()
+  {
+    close ();
+  }
+
+  // NOTE: Streams and caps known upfront go into header, call before open
+  void declare_stream (uint8_t element_identifier, GstCaps* caps = nullptr)
+  {
+    stream_table.emplace_back (element_identifier, caps ? add_caps_string (caps_to_string (caps)).first : g_no_caps_identifier);
+  }
+
   void open ()
   {
-    stream.open ("appsrc", std::ios_base::binary | std::ios_base::out);
+    if (!is_supported (compression)) {
+      GST_WARNING ("Compression %u is not available in this build, writing uncompressed", static_cast<unsigned int> (compression));
+      compression = Compression::None;
+    }
+    key_element_identifier = -1;
+    arrival_origin = g_get_monotonic_time ();
+    if (ring) {
+      ring_sequence = 0;
+      ring_bytes = 0;
+      return;
+    }
+    segment_number = 0;
+    segment_path_list.clear ();
+    open_segment ();
+    if (concurrent) {
+      // NOTE: Declared streams are waited for from the start, other streams join merging once they stage something
+      for (auto&& element : stream_table) {
+        auto& staging_queue = staging_queue_list[element.first];
+        if (!staging_queue.load ())
+          staging_queue = new StagingQueue (staging_capacity);
+        staging_queue.load ()->active = true;
+      }
+      staging_generation++;
+      termination = false;
+      writer_thread = std::thread ([&] { run_merger (); });
+    } else if (asynchronous) {
+      termination = false;
+      writer_thread = std::thread ([&] { run_writer (); });
+    }
   }
   void close ()
   {
-    stream.close ();
+    if (writer_thread.joinable ()) {
+      {
+        std::unique_lock queue_lock (queue_mutex);
+        termination = true;
+        queue_condition.notify_all ();
+      }
+      writer_thread.join ();
+    }
+    // NOTE: Entries staged after the merger finished (or without one running) still hold references
+    for (auto&& staging_queue : staging_queue_list) {
+      const auto staging_queue_value = staging_queue.exchange (nullptr);
+      if (!staging_queue_value)
+        continue;
+      for (Entry* entry; (entry = staging_queue_value->front ()); staging_queue_value->pop ()) {
+        queued_bytes -= entry->size;
+        if (entry->caps)
+          gst_caps_unref (std::exchange (entry->caps, nullptr));
+        if (entry->buffer)
+          gst_buffer_unref (std::exchange (entry->buffer, nullptr));
+      }
+      delete staging_queue_value;
+    }
+    if (dump_thread.joinable ())
+      dump_thread.join ();
+    close_segment ();
+    for (auto&& caps : caps_list)
+      if (caps)
+        gst_caps_unref (std::exchange (caps, nullptr));
+    for (; !ring_entry_list.empty (); ring_sequence++)
+      pop_ring_entry ();
+    ring_boundary_list.clear ();
+    for (auto&& caps : ring_caps_list)
+      if (caps)
+        gst_caps_unref (std::exchange (caps, nullptr));
+#if defined(WITH_ZSTD)
+    if (zstd_context)
+      ZSTD_freeCCtx (std::exchange (zstd_context, nullptr));
+#endif
+  }
+
+  bool is_segmented () const
+  {
+    return segment_size || GST_CLOCK_TIME_IS_VALID (segment_duration);
+  }
+  // NOTE: Starts a new file with header and fresh per-file state; compact records, index and blocks never refer
+  //       across files
+  void open_segment ()
+  {
+    auto segment_path = path;
+    if (is_segmented ()) {
+      char suffix[32];
+      snprintf (suffix, sizeof suffix, ".%06u", segment_number++);
+      segment_path.append (suffix);
+    }
+    if (!output.open (segment_path.c_str ()))
+      GST_ERROR ("Failed to open %s", segment_path.c_str ());
+    segment_path_list.emplace_back (segment_path);
+    if (segment_count)
+      for (; segment_path_list.size () > segment_count; segment_path_list.pop_front ()) {
+        GST_INFO ("Removing segment %s", segment_path_list.front ().c_str ());
+        std::remove (segment_path_list.front ().c_str ());
+      }
+    blocking = false;
+    write_header ();
+    blocking = compression != Compression::None;
+    std::fill (std::begin (compact_state_list), std::end (compact_state_list), CompactState ());
+    std::fill (std::begin (caps_offset_list), std::end (caps_offset_list), std::numeric_limits<uint64_t>::max ());
+    std::fill (std::begin (index_time_list), std::end (index_time_list), GST_CLOCK_TIME_NONE);
+    segment_time = GST_CLOCK_TIME_NONE;
+  }
+  void close_segment ()
+  {
+    if (blocking) {
+      write_block ();
+      blocking = false;
+    }
+    if (index && output.descriptor >= 0)
+      write_index ();
+    output.close ();
+  }
+  // NOTE: Segments and the flight recorder window are cut on key frames only; the first stream seen with delta units
+  //       (typically video) is the one to align on, streams without delta units are aligned on every buffer anyway.
+  //       Further streams with delta units may start a segment with delta units up to their next key frame
+  bool is_key_frame_boundary (GstBuffer* buffer, uint8_t element_identifier)
+  {
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      if (key_element_identifier < 0)
+        key_element_identifier = element_identifier;
+      return false;
+    }
+    return key_element_identifier < 0 || key_element_identifier == element_identifier;
+  }
+  bool is_segment_boundary (GstBuffer* buffer, uint8_t element_identifier)
+  {
+    if (!is_key_frame_boundary (buffer, element_identifier))
+      return false;
+    if (segment_size && output.position + block.size () >= segment_size)
+      return true;
+    const auto time = GST_BUFFER_DTS_OR_PTS (buffer);
+    return GST_CLOCK_TIME_IS_VALID (segment_duration) && GST_CLOCK_TIME_IS_VALID (segment_time) && GST_CLOCK_TIME_IS_VALID (time) && time >= segment_time + segment_duration;
+  }
+  // NOTE: Next segment header declares every stream with its current caps, and caps records are repeated at the head
+  //       so that index entries of the new file have caps records to point to
+  void roll_segment ()
+  {
+    close_segment ();
+    for (unsigned int element_identifier = 0; element_identifier < std::size (caps_list); element_identifier++) {
+      if (!caps_list[element_identifier])
+        continue;
+      const auto iterator = std::find_if (stream_table.begin (), stream_table.end (), [&] (auto&& element) { return element.first == element_identifier; });
+      if (iterator != stream_table.end ())
+        iterator->second = caps_identifier_list[element_identifier];
+      else
+        stream_table.emplace_back (static_cast<uint8_t> (element_identifier), caps_identifier_list[element_identifier]);
+    }
+    open_segment ();
+    GST_INFO ("Segment %s", segment_path_list.back ().c_str ());
+    for (unsigned int element_identifier = 0; element_identifier < std::size (caps_list); element_identifier++)
+      if (caps_list[element_identifier])
+        write_caps (caps_list[element_identifier], static_cast<uint8_t> (element_identifier));
   }
+
   void write (const void* data, size_t data_size)
   {
-    stream.write (reinterpret_cast<const char*> (data), data_size);
+    if (blocking) {
+      const auto bytes = reinterpret_cast<const uint8_t*> (data);
+      block.insert (block.end (), bytes, bytes + data_size);
+      return;
+    }
+    if (checksum)
+      record_checksum = Crc32c::update (record_checksum, data, data_size);
+    output.stage (data, data_size);
+  }
+  // NOTE: Checksum of the record header written so far, in front of the payload; part of the record checksum too
+  void write_header_checksum ()
+  {
+    if (!checksum || blocking)
+      return;
+    write_as (record_checksum);
+  }
+  // NOTE: Completes a record written outside of a block with its checksum
+  void end_record ()
+  {
+    if (!checksum || blocking)
+      return;
+    output.stage (&record_checksum, sizeof record_checksum);
+    record_checksum = 0;
   }
   template<typename ValueType>
   void write (const ValueType& value)
@@ -27,13 +941,42 @@ struct AppsrcFile {
   {
     write (&value, sizeof value);
   }
+  // NOTE: Writes buffer memory blocks out directly (scatter/gather), no intermediate copy of the payload
+  void write (GstBuffer* buffer)
+  {
+    g_assert_nonnull (buffer);
+    const auto memory_count = gst_buffer_n_memory (buffer);
+    const auto direct = !blocking && gst_buffer_get_size (buffer) >= Output::g_direct_size;
+    for (guint index = 0; index < memory_count; index++) {
+      const auto memory = gst_buffer_peek_memory (buffer, index);
+      GstMapInfo map_info;
+      if (!gst_memory_map (memory, &map_info, GST_MAP_READ)) {
+        // NOTE: The record already declares the payload size, the memory block is written as zeros so that later
+        //       records stay aligned
+        const auto size = gst_memory_get_sizes (memory, nullptr, nullptr);
+        GST_ERROR ("Failed to map memory block of %" G_GSIZE_FORMAT " bytes, writing zeros instead", size);
+        write_zeros (size);
+        continue;
+      }
+      if (checksum && direct)
+        record_checksum = Crc32c::update (record_checksum, map_info.data, map_info.size);
+      if (direct) {
+        output.attach (memory, map_info);
+        continue;
+      }
+      write (map_info.data, map_info.size);
+      gst_memory_unmap (memory, &map_info);
+    }
+  }
+  void write_zeros (size_t size)
+  {
+    static uint8_t constexpr const zero_list[4 << 10] {};
+    for (; size; size -= std::min (size, sizeof zero_list))
+      write (zero_list, std::min (size, sizeof zero_list));
+  }
 
-  void handle_caps (GstCaps* caps, uint8_t element_identifier = 0)
+  static std::string caps_to_string (GstCaps* caps)
   {
-    g_assert_nonnull (caps);
-    static uint8_t constexpr const g_identifier = 1;
-    write (g_identifier);
-    write (element_identifier);
     std::string caps_string;
     if (caps) {
       gchar* string = gst_caps_to_string (caps);
@@ -42,35 +985,726 @@ struct AppsrcFile {
         g_free (string);
       }
     }
+    return caps_string;
+  }
+  // NOTE: Returns dictionary identifier of the caps and whether they were added
+  std::pair<uint16_t, bool> add_caps_string (const std::string& caps_string)
+  {
+    const auto iterator = caps_identifier_map.find (caps_string);
+    if (iterator != caps_identifier_map.end ())
+      return std::make_pair (iterator->second, false);
+    const auto caps_identifier = static_cast<uint16_t> (caps_string_list.size ());
+    g_assert_true (caps_identifier != g_no_caps_identifier);
+    caps_identifier_map.emplace (caps_string, caps_identifier);
+    caps_string_list.emplace_back (caps_string);
+    return std::make_pair (caps_identifier, true);
+  }
+  void write_caps_string (const std::string& caps_string)
+  {
     const auto size = static_cast<uint16_t> (caps_string.size ());
     write (size);
-    write (caps_string.data (), caps_string.size ());
+    write (caps_string.data (), size);
   }
-  void handle_buffer (GstBuffer* buffer, uint8_t element_identifier = 0)
+  void write_caps_dictionary ()
+  {
+    write_as (static_cast<uint16_t> (caps_string_list.size ()));
+    for (auto&& caps_string : caps_string_list)
+      write_caps_string (caps_string);
+  }
+  uint64_t caps_dictionary_size () const
+  {
+    uint64_t size = sizeof (uint16_t);
+    for (auto&& caps_string : caps_string_list)
+      size += sizeof (uint16_t) + static_cast<uint16_t> (caps_string.size ());
+    return size;
+  }
+  void write_header ()
+  {
+    write (g_header_magic, sizeof g_header_magic);
+    write (g_version);
+    write_as<uint16_t> ((compact ? g_compact_flag : 0) | (compression == Compression::Lz4 ? g_lz4_flag : 0) | (compression == Compression::Zstd ? g_zstd_flag : 0) | (arrival ? g_arrival_flag : 0) | (checksum ? g_checksum_flag : 0));
+    write_as (static_cast<uint32_t> (1 + stream_table.size () * 3 + caps_dictionary_size ()));
+    write_as (static_cast<uint8_t> (stream_table.size ()));
+    for (auto&& element : stream_table) {
+      write (element.first);
+      write (element.second);
+    }
+    write_caps_dictionary ();
+    record_checksum = 0;
+  }
+  void write_caps (GstCaps* caps, uint8_t element_identifier)
+  {
+    // NOTE: Repeated caps of the stream are detected without serialization, other caps are looked up in the dictionary
+    //       and defined inline when new
+    auto& stream_caps = caps_list[element_identifier];
+    auto& caps_identifier = caps_identifier_list[element_identifier];
+    if (!stream_caps || (stream_caps != caps && !gst_caps_is_equal (stream_caps, caps))) {
+      const auto caps_string = caps_to_string (caps);
+      bool added;
+      std::tie (caps_identifier, added) = add_caps_string (caps_string);
+      if (added) {
+        write (g_caps_definition_identifier);
+        write_as<uint8_t> (0);
+        write (caps_identifier);
+        write_caps_string (caps_string);
+        end_record ();
+      }
+      if (stream_caps)
+        gst_caps_unref (stream_caps);
+      stream_caps = gst_caps_ref (caps);
+    }
+    std::tie (caps_offset_list[element_identifier], caps_block_offset_list[element_identifier]) = get_position ();
+    write (g_caps_identifier);
+    write (element_identifier);
+    write (caps_identifier);
+    end_record ();
+  }
+  void write_buffer (GstBuffer* buffer, uint8_t element_identifier, guint flags = 0, gint64 time = g_get_monotonic_time ())
+  {
+    write_buffer (buffer, element_identifier, flags, time, static_cast<uint32_t> (gst_buffer_get_size (buffer)), [&] { write (buffer); });
+  }
+  // NOTE: Buffer record of flags and timestamps of the buffer, with data_size bytes of payload from write_payload
+  template<typename WritePayload>
+  void write_buffer (GstBuffer* buffer, uint8_t element_identifier, guint flags, gint64 time, uint32_t data_size, WritePayload&& write_payload)
   {
-    g_assert_nonnull (buffer);
     static uint8_t constexpr const g_identifier = 2;
+    if (is_segmented ()) {
+      if (is_segment_boundary (buffer, element_identifier))
+        roll_segment ();
+      if (!GST_CLOCK_TIME_IS_VALID (segment_time))
+        segment_time = GST_BUFFER_DTS_OR_PTS (buffer);
+    }
+    const auto position = get_position ();
+    // NOTE: With checksums, compact records are synchronized on key frames as often as they are indexed even without
+    //       index, so that replay recovers past corrupt data
+    const auto synchronized = (index || checksum) && is_index_entry (buffer, element_identifier);
+    const auto indexed = index && synchronized;
+    if (arrival) {
+      uint8_t data[2 + 10] { g_arrival_identifier, element_identifier };
+      write (data, 2 + encode_varint (data + 2, static_cast<uint64_t> (std::max<gint64> (time - arrival_origin, 0))));
+      end_record ();
+    }
+    if (compact) {
+      uint8_t data[CompactState::g_capacity + 5];
+      auto size = compact_state_list[element_identifier].encode (data, element_identifier, GST_BUFFER_FLAGS (buffer) | flags, GST_BUFFER_DTS (buffer), GST_BUFFER_PTS (buffer), GST_BUFFER_DURATION (buffer), synchronized);
+      size += encode_varint (data + size, data_size);
+      write (data, size);
+    } else {
+      write (g_identifier);
+      write (element_identifier);
+      {
+        write_as (static_cast<uint64_t> (GST_BUFFER_FLAGS (buffer) | flags));
+        write_as (static_cast<int64_t> GST_BUFFER_DTS (buffer));
+        write_as (static_cast<int64_t> GST_BUFFER_PTS (buffer));
+        write_as (static_cast<int64_t> GST_BUFFER_DURATION (buffer));
+      }
+      write (data_size);
+    }
+    write_header_checksum ();
+    write_payload ();
+    end_record ();
+    if (indexed)
+      index_entry_list.push_back ({ element_identifier, position.first, caps_offset_list[element_identifier], static_cast<int64_t> GST_BUFFER_DTS (buffer), static_cast<int64_t> GST_BUFFER_PTS (buffer), position.second, caps_block_offset_list[element_identifier] });
+    if (blocking && block.size () >= block_size)
+      write_block ();
+  }
+  // NOTE: Buffer record with the payload copied over from a range of another file by the kernel, the buffer only
+  //       carries flags and timestamps; synchronous output without compression only, used for slicing record files.
+  //       The payload is only looked at with checksums, data is then its copy in memory (e.g. mapped)
+  void write_buffer_range (GstBuffer* buffer, uint8_t element_identifier, gint64 time, int source_descriptor, uint64_t offset, uint32_t size, const void* data = nullptr)
+  {
+    g_assert_true (!ring && !asynchronous && !concurrent && compression == Compression::None);
+    g_assert_true (!checksum || data || !size);
+    write_buffer (buffer, element_identifier, 0, time, size, [&] {
+      if (checksum)
+        record_checksum = Crc32c::update (record_checksum, data, size);
+      if (!output.copy (source_descriptor, offset, size))
+        GST_ERROR ("Failed to copy %u bytes from offset %" G_GUINT64_FORMAT, size, offset);
+    });
+  }
+  // NOTE: Position of the next record, in compression mode the pending block is the next thing to go into the file
+  std::pair<uint64_t, uint32_t> get_position () const
+  {
+    return std::make_pair (output.position, static_cast<uint32_t> (block.size ()));
+  }
+  void write_block ()
+  {
+    if (block.empty ())
+      return;
+    size_t compressed_size = 0;
+    switch (compression) {
+#if defined(WITH_LZ4)
+      case Compression::Lz4: {
+        compressed_block.resize (LZ4_compressBound (static_cast<int> (block.size ())));
+        const auto result = LZ4_compress_default (reinterpret_cast<const char*> (block.data ()), reinterpret_cast<char*> (compressed_block.data ()), static_cast<int> (block.size ()), static_cast<int> (compressed_block.size ()));
+        if (result > 0)
+          compressed_size = static_cast<size_t> (result);
+      } break;
+#endif
+#if defined(WITH_ZSTD)
+      case Compression::Zstd: {
+        if (!zstd_context)
+          zstd_context = ZSTD_createCCtx ();
+        compressed_block.resize (ZSTD_compressBound (block.size ()));
+        const auto result = ZSTD_compressCCtx (zstd_context, compressed_block.data (), compressed_block.size (), block.data (), block.size (), compression_level);
+        if (!ZSTD_isError (result))
+          compressed_size = result;
+      } break;
+#endif
+      default:
+        break;
+    }
+    // NOTE: Recording goes on with the block stored uncompressed
+    auto block_compression = compression;
+    if (!compressed_size) {
+      GST_WARNING ("Failed to compress block of %zu bytes, writing it uncompressed", block.size ());
+      block_compression = Compression::None;
+      compressed_block.assign (block.begin (), block.end ());
+      compressed_size = block.size ();
+    }
+    if (index)
+      block_entry_list.push_back ({ output.position, static_cast<uint32_t> (block.size ()), static_cast<uint32_t> (compressed_size) });
+    const uint8_t header[] { g_block_identifier, 0, static_cast<uint8_t> (block_compression) };
+    output.stage (header, sizeof header);
+    const auto size = static_cast<uint32_t> (block.size ());
+    output.stage (&size, sizeof size);
+    const auto compressed_size_value = static_cast<uint32_t> (compressed_size);
+    output.stage (&compressed_size_value, sizeof compressed_size_value);
+    if (checksum) {
+      auto value = Crc32c::update (0, header, sizeof header);
+      value = Crc32c::update (value, &size, sizeof size);
+      const auto header_value = Crc32c::update (value, &compressed_size_value, sizeof compressed_size_value);
+      output.stage (&header_value, sizeof header_value);
+      value = Crc32c::update (header_value, &header_value, sizeof header_value);
+      value = Crc32c::update (value, compressed_block.data (), compressed_size);
+      output.stage (compressed_block.data (), compressed_size);
+      output.stage (&value, sizeof value);
+    } else
+      output.stage (compressed_block.data (), compressed_size);
+    block.clear ();
+  }
+  bool is_index_entry (GstBuffer* buffer, uint8_t element_identifier)
+  {
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+      return false;
+    const auto time = GST_BUFFER_DTS_OR_PTS (buffer);
+    if (!GST_CLOCK_TIME_IS_VALID (time))
+      return false;
+    auto& index_time = index_time_list[element_identifier];
+    if (GST_CLOCK_TIME_IS_VALID (index_time) && time < index_time + index_interval)
+      return false;
+    index_time = time;
+    return true;
+  }
+  void write_index ()
+  {
+    const auto offset = output.position;
+    const auto block_entry_size = compression != Compression::None ? 2 * sizeof (uint32_t) : 0;
+    const auto section_size = static_cast<uint64_t> (index_entry_list.size () * (IndexEntry::g_size + block_entry_size));
+    const auto caps_section_size = caps_dictionary_size ();
+    const auto block_section_size = static_cast<uint64_t> (block_entry_list.size () * (sizeof (uint64_t) + 2 * sizeof (uint32_t)));
+    const auto section_count = block_entry_size ? 3 : 2;
+    write (g_index_identifier);
+    write_as<uint8_t> (0);
+    write_as<uint64_t> (section_count * (1 + sizeof (uint64_t)) + section_size + caps_section_size + (block_entry_size ? block_section_size : 0));
+    write (g_index_caps_section);
+    write (caps_section_size);
+    write_caps_dictionary ();
+    write (block_entry_size ? g_index_block_key_frame_section : g_index_key_frame_section);
+    write (section_size);
+    for (auto&& entry : index_entry_list) {
+      write (entry.element_identifier);
+      write (entry.offset);
+      write (entry.caps_offset);
+      write (entry.dts);
+      write (entry.pts);
+      if (block_entry_size) {
+        write (entry.block_offset);
+        write (entry.caps_block_offset);
+      }
+    }
+    if (block_entry_size) {
+      write (g_index_block_section);
+      write (block_section_size);
+      for (auto&& entry : block_entry_list) {
+        write (entry.offset);
+        write (entry.size);
+        write (entry.compressed_size);
+      }
+    }
+    end_record ();
+    write (g_footer_identifier);
+    write_as<uint8_t> (0);
+    write_as<uint64_t> (offset);
+    write (g_footer_magic, sizeof g_footer_magic);
+    record_checksum = 0;
+    index_entry_list.clear ();
+    block_entry_list.clear ();
+  }
+  void write_end_of_stream (uint8_t element_identifier)
+  {
+    static uint8_t constexpr const g_identifier = 3;
     write (g_identifier);
     write (element_identifier);
+    end_record ();
+  }
+  void write_entry (Entry& entry)
+  {
+    switch (entry.type) {
+      case 1:
+        write_caps (entry.caps, entry.element_identifier);
+        gst_caps_unref (std::exchange (entry.caps, nullptr));
+        break;
+      case 2:
+        write_buffer (entry.buffer, entry.element_identifier, entry.flags, entry.time);
+        gst_buffer_unref (std::exchange (entry.buffer, nullptr));
+        break;
+      case 3:
+        write_end_of_stream (entry.element_identifier);
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+  }
+
+  // NOTE: Queues the entry for the writer thread, returns false if the entry is dropped
+  bool enqueue (Entry&& entry)
+  {
+    std::unique_lock queue_lock (queue_mutex);
+    if (entry.type == 2) {
+      auto& dropping = dropping_list[entry.element_identifier];
+      if (dropping && GST_BUFFER_FLAG_IS_SET (entry.buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        drop (entry);
+        return false;
+      }
+      dropping = false;
+      // NOTE: Entries the writer has taken out of the queue still count until written; only an entry larger than
+      //       the whole capacity goes in past it, once nothing else is in flight
+      if (queued_bytes.load () + entry.size > queue_capacity && queued_bytes.load () != 0) {
+        if (overflow_policy != OverflowPolicy::Block) {
+          dropping = true;
+          drop (entry);
+          return false;
+        }
+        space_condition.wait (queue_lock, [&] { return queued_bytes.load () + entry.size <= queue_capacity || queued_bytes.load () == 0; });
+      }
+      if (std::exchange (discontinuity_list[entry.element_identifier], false))
+        entry.flags |= GST_BUFFER_FLAG_DISCONT;
+    }
+    queued_bytes += entry.size;
+    queue.emplace_back (std::move (entry));
+    queue_condition.notify_one ();
+    return true;
+  }
+  void drop (Entry& entry)
+  {
+    if (overflow_policy == OverflowPolicy::CountAndDrop) {
+      dropped_buffer_count++;
+      dropped_bytes += entry.size;
+      discontinuity_list[entry.element_identifier] = true;
+    }
+    gst_buffer_unref (std::exchange (entry.buffer, nullptr));
+  }
+  void run_writer ()
+  {
+    std::deque<Entry> entry_list;
+    for (;;) {
+      {
+        std::unique_lock queue_lock (queue_mutex);
+        queue_condition.wait (queue_lock, [&] { return !queue.empty () || termination; });
+        if (queue.empty ())
+          break;
+        std::swap (entry_list, queue);
+      }
+      // NOTE: The whole batch goes out in as few writev calls as staging and attachment limits allow
+      size_t size = 0;
+      for (auto&& entry : entry_list) {
+        write_entry (entry);
+        size += entry.size;
+      }
+      entry_list.clear ();
+      output.flush ();
+      {
+        std::unique_lock queue_lock (queue_mutex);
+        queued_bytes -= size;
+        space_condition.notify_all ();
+      }
+    }
+  }
+
+  // NOTE: Flight recorder mode, entries are kept in memory holding references to caps and buffers; the window starts
+  //       on a key frame boundary and is trimmed, one key frame interval at a time, while it is above ring_capacity
+  //       or while what follows the next boundary still spans ring_duration
+  void push_ring_entry (Entry&& entry)
+  {
+    std::unique_lock ring_lock (ring_mutex);
+    if (entry.type == 2) {
+      const auto time = GST_BUFFER_DTS_OR_PTS (entry.buffer);
+      if (is_key_frame_boundary (entry.buffer, entry.element_identifier))
+        ring_boundary_list.emplace_back (ring_sequence + ring_entry_list.size (), time);
+      if (GST_CLOCK_TIME_IS_VALID (time))
+        ring_time = time;
+    }
+    ring_bytes += entry.size;
+    ring_entry_list.emplace_back (std::move (entry));
+    for (;;) {
+      while (!ring_boundary_list.empty () && ring_boundary_list.front ().first <= ring_sequence)
+        ring_boundary_list.pop_front ();
+      if (ring_boundary_list.empty ())
+        break;
+      const auto [sequence, time] = ring_boundary_list.front ();
+      const auto expired = GST_CLOCK_TIME_IS_VALID (ring_duration) && GST_CLOCK_TIME_IS_VALID (time) && GST_CLOCK_TIME_IS_VALID (ring_time) && ring_time >= time + ring_duration;
+      if (ring_bytes <= ring_capacity && !expired)
+        break;
+      for (; ring_sequence < sequence; ring_sequence++)
+        pop_ring_entry ();
+    }
+  }
+  // NOTE: Caps leaving the window are kept as caps of the stream at window start
+  void pop_ring_entry ()
+  {
+    auto& entry = ring_entry_list.front ();
+    ring_bytes -= entry.size;
+    if (entry.caps) {
+      auto& caps = ring_caps_list[entry.element_identifier];
+      if (caps)
+        gst_caps_unref (caps);
+      caps = std::exchange (entry.caps, nullptr);
+    }
+    if (entry.buffer)
+      gst_buffer_unref (entry.buffer);
+    ring_entry_list.pop_front ();
+  }
+  // NOTE: Writes current flight recorder window into a file on a background thread, with the settings of this
+  //       instance (except segmentation); returns false if the previous dump is still in progress
+  bool trigger (const std::string& dump_path)
+  {
+    g_assert_true (ring);
+    if (dumping.exchange (true)) {
+      GST_WARNING ("Dump to %s skipped, previous dump is still in progress", dump_path.c_str ());
+      return false;
+    }
+    if (dump_thread.joinable ())
+      dump_thread.join ();
+    std::vector<std::pair<uint8_t, GstCaps*>> stream_caps_list;
+    std::vector<Entry> entry_list;
     {
-      write_as (static_cast<uint64_t> GST_BUFFER_FLAGS (buffer));
-      write_as (static_cast<int64_t> GST_BUFFER_DTS (buffer));
-      write_as (static_cast<int64_t> GST_BUFFER_PTS (buffer));
-      write_as (static_cast<int64_t> GST_BUFFER_DURATION (buffer));
+      std::unique_lock ring_lock (ring_mutex);
+      for (unsigned int element_identifier = 0; element_identifier < std::size (ring_caps_list); element_identifier++)
+        if (ring_caps_list[element_identifier])
+          stream_caps_list.emplace_back (static_cast<uint8_t> (element_identifier), gst_caps_ref (ring_caps_list[element_identifier]));
+      entry_list.reserve (ring_entry_list.size ());
+      for (auto&& entry : ring_entry_list) {
+        entry_list.emplace_back (entry);
+        if (entry.caps)
+          gst_caps_ref (entry.caps);
+        if (entry.buffer)
+          gst_buffer_ref (entry.buffer);
+      }
+    }
+    dump_thread = std::thread ([this, dump_path, stream_caps_list = std::move (stream_caps_list), entry_list = std::move (entry_list)] () mutable {
+      dump (dump_path, stream_caps_list, entry_list);
+      dumping = false;
+    });
+    return true;
+  }
+  void dump (const std::string& dump_path, std::vector<std::pair<uint8_t, GstCaps*>>& stream_caps_list, std::vector<Entry>& entry_list)
+  {
+    AppsrcFile file;
+    file.path = dump_path;
+    file.index = index;
+    file.index_interval = index_interval;
+    file.compact = compact;
+    file.compression = compression;
+    file.compression_level = compression_level;
+    file.block_size = block_size;
+    file.arrival = arrival;
+    file.checksum = checksum;
+    for (auto&& [element_identifier, caps] : stream_caps_list)
+      file.declare_stream (element_identifier, caps);
+    file.open ();
+    const auto iterator = std::find_if (entry_list.begin (), entry_list.end (), [] (auto&& entry) { return entry.type == 2; });
+    if (iterator != entry_list.end ())
+      file.arrival_origin = iterator->time;
+    for (auto&& [element_identifier, caps] : stream_caps_list) {
+      file.write_caps (caps, element_identifier);
+      gst_caps_unref (caps);
+    }
+    // NOTE: Streams other than the one the window is aligned on start with their first key frame
+    bool key_frame_list[256] {};
+    for (auto&& entry : entry_list) {
+      if (entry.type == 2) {
+        auto& key_frame = key_frame_list[entry.element_identifier];
+        if (!key_frame && GST_BUFFER_FLAG_IS_SET (entry.buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+          gst_buffer_unref (std::exchange (entry.buffer, nullptr));
+          continue;
+        }
+        key_frame = true;
+      }
+      file.write_entry (entry);
+    }
+    file.close ();
+    GST_INFO ("Dumped %zu entries to %s", entry_list.size (), dump_path.c_str ());
+  }
+
+  // NOTE: Concurrent mode, called on the thread which pushes the stream; there must be at most one such thread per
+  //       stream at a time, different streams do not share any lock
+  bool stage (Entry&& entry)
+  {
+    auto staging_queue = staging_queue_list[entry.element_identifier].load (std::memory_order_acquire);
+    if (!staging_queue) {
+      staging_queue = new StagingQueue (staging_capacity);
+      staging_queue_list[entry.element_identifier].store (staging_queue, std::memory_order_release);
+      staging_generation++;
+    }
+    if (entry.type == 2) {
+      auto& dropping = dropping_list[entry.element_identifier];
+      if (dropping && GST_BUFFER_FLAG_IS_SET (entry.buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        drop (entry);
+        return false;
+      }
+      dropping = false;
+      if (std::exchange (discontinuity_list[entry.element_identifier], false))
+        entry.flags |= GST_BUFFER_FLAG_DISCONT;
+    }
+    entry.time = g_get_monotonic_time ();
+    // NOTE: Accounted before the push, the merger may write and subtract the entry before push returns
+    queued_bytes += entry.size;
+    if (!staging_queue->push (entry)) {
+      if (entry.type == 2 && overflow_policy != OverflowPolicy::Block) {
+        queued_bytes -= entry.size;
+        dropping_list[entry.element_identifier] = true;
+        drop (entry);
+        return false;
+      }
+      // NOTE: The merger signals space under the lock after popping, a retry under the lock cannot miss it
+      std::unique_lock queue_lock (queue_mutex);
+      space_condition.wait (queue_lock, [&] { return staging_queue->push (entry); });
+    }
+    wake_merger ();
+    return true;
+  }
+  // NOTE: Staging takes the lock only while the merger sleeps; the fences pair up so that either the merger sees the
+  //       staged entry before it sleeps or the staging thread sees it sleeping
+  void wake_merger ()
+  {
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    if (merger_waiting.load (std::memory_order_relaxed)) {
+      std::unique_lock queue_lock (queue_mutex);
+      queue_condition.notify_one ();
     }
-    std::vector<uint8_t> data;
-    data.resize (gst_buffer_get_size (buffer));
-    gst_buffer_extract (buffer, 0, data.data (), static_cast<gsize> (data.size ()));
-    const auto data_size = static_cast<uint32_t> (data.size ());
-    write (data_size);
-    write (data.data (), data.size ());
+  }
+  // NOTE: Picks the stream whose staged entry goes into the file next: entries without time (caps, end of stream,
+  //       buffers without timestamps) right away, otherwise the earliest buffer once every active stream has something
+  //       staged, or once the oldest staged entry waited for merge_latency, so that an idle stream does not hold back
+  //       the others
+  StagingQueue* select_staging_queue (const std::vector<StagingQueue*>& merge_list, bool draining) const
+  {
+    StagingQueue* selection = nullptr;
+    GstClockTime selection_time = GST_CLOCK_TIME_NONE;
+    auto complete = true;
+    auto staging_time = std::numeric_limits<gint64>::max ();
+    for (auto&& staging_queue : merge_list) {
+      const auto entry = staging_queue->front ();
+      if (!entry) {
+        if (staging_queue->active)
+          complete = false;
+        continue;
+      }
+      if (entry->type != 2)
+        return staging_queue;
+      const auto time = GST_BUFFER_DTS_OR_PTS (entry->buffer);
+      if (!GST_CLOCK_TIME_IS_VALID (time))
+        return staging_queue;
+      if (!selection || time < selection_time) {
+        selection = staging_queue;
+        selection_time = time;
+      }
+      staging_time = std::min (staging_time, entry->time);
+    }
+    if (!selection || complete || draining)
+      return selection;
+    return static_cast<GstClockTime> (g_get_monotonic_time () - staging_time) * GST_USECOND >= merge_latency ? selection : nullptr;
+  }
+  void run_merger ()
+  {
+    std::vector<StagingQueue*> merge_list;
+    auto generation = std::numeric_limits<unsigned int>::max ();
+    for (;;) {
+      bool draining;
+      {
+        std::unique_lock queue_lock (queue_mutex);
+        draining = termination;
+      }
+      if (generation != staging_generation.load ()) {
+        generation = staging_generation.load ();
+        merge_list.clear ();
+        for (auto&& staging_queue : staging_queue_list)
+          if (const auto staging_queue_value = staging_queue.load (std::memory_order_acquire))
+            merge_list.push_back (staging_queue_value);
+      }
+      size_t size = 0;
+      while (const auto staging_queue = select_staging_queue (merge_list, draining)) {
+        auto& entry = *staging_queue->front ();
+        staging_queue->active = entry.type != 3;
+        size += entry.size;
+        write_entry (entry);
+        staging_queue->pop ();
+      }
+      if (size) {
+        output.flush ();
+        queued_bytes -= size;
+      }
+      std::unique_lock queue_lock (queue_mutex);
+      if (size)
+        space_condition.notify_all ();
+      if (draining && generation == staging_generation.load ())
+        break;
+      // NOTE: Sleeps until something can be merged, a stream is added or closing starts; staged entries held back for
+      //       an idle stream are due once the oldest of them waited for merge_latency
+      merger_waiting.store (true, std::memory_order_relaxed);
+      std::atomic_thread_fence (std::memory_order_seq_cst);
+      if (!termination && generation == staging_generation.load () && !select_staging_queue (merge_list, false)) {
+        auto staging_time = std::numeric_limits<gint64>::max ();
+        for (auto&& staging_queue : merge_list)
+          if (const auto entry = staging_queue->front ())
+            staging_time = std::min (staging_time, entry->time);
+        if (staging_time != std::numeric_limits<gint64>::max ())
+          queue_condition.wait_for (queue_lock, std::chrono::microseconds (staging_time - g_get_monotonic_time ()) + std::chrono::nanoseconds (merge_latency));
+        else
+          queue_condition.wait (queue_lock);
+      }
+      merger_waiting.store (false, std::memory_order_relaxed);
+    }
+  }
+
+  void handle_caps (GstCaps* caps, uint8_t element_identifier = 0)
+  {
+    g_assert_nonnull (caps);
+    if (ring) {
+      push_ring_entry ({ 1, element_identifier, gst_caps_ref (caps), nullptr, 64, 0 });
+      return;
+    }
+    if (concurrent) {
+      stage ({ 1, element_identifier, gst_caps_ref (caps), nullptr, 64, 0 });
+      return;
+    }
+    if (asynchronous) {
+      enqueue ({ 1, element_identifier, gst_caps_ref (caps), nullptr, 64, 0 });
+      return;
+    }
+    write_caps (caps, element_identifier);
+  }
+  void handle_buffer (GstBuffer* buffer, uint8_t element_identifier = 0)
+  {
+    g_assert_nonnull (buffer);
+    if (ring) {
+      push_ring_entry ({ 2, element_identifier, nullptr, gst_buffer_ref (buffer), 64 + gst_buffer_get_size (buffer), 0, g_get_monotonic_time () });
+      return;
+    }
+    if (concurrent) {
+      stage ({ 2, element_identifier, nullptr, gst_buffer_ref (buffer), 64 + gst_buffer_get_size (buffer), 0, g_get_monotonic_time () });
+      return;
+    }
+    if (asynchronous) {
+      enqueue ({ 2, element_identifier, nullptr, gst_buffer_ref (buffer), 64 + gst_buffer_get_size (buffer), 0, g_get_monotonic_time () });
+      return;
+    }
+    write_buffer (buffer, element_identifier);
+    if (output.attached_size)
+      output.flush ();
   }
   void handle_end_of_stream (uint8_t element_identifier = 0)
   {
-    static uint8_t constexpr const g_identifier = 3;
-    write (g_identifier);
-    write (element_identifier);
+    if (ring) {
+      push_ring_entry ({ 3, element_identifier, nullptr, nullptr, 16, 0 });
+      return;
+    }
+    if (concurrent) {
+      stage ({ 3, element_identifier, nullptr, nullptr, 16, 0 });
+      return;
+    }
+    if (asynchronous) {
+      enqueue ({ 3, element_identifier, nullptr, nullptr, 16, 0 });
+      return;
+    }
+    write_end_of_stream (element_identifier);
   }
 
-  std::ofstream stream;
+  std::string path = "appsrc"; // Output file, or prefix of segment files
+  // NOTE: Segmented recording: the file is rolled over on a key frame once it reaches segment_size bytes or spans
+  //       segment_duration, segments are named <path>.<number> and each can be replayed on its own
+  uint64_t segment_size = 0; // No limit if zero
+  GstClockTime segment_duration = GST_CLOCK_TIME_NONE;
+  size_t segment_count = 0; // Segments to keep, older ones are deleted; all are kept if zero
+  // NOTE: Flight recorder mode keeps references to buffers, upstream buffer pools with a fixed number of buffers
+  //       might run dry while buffers are held in the window
+  bool ring = false; // Keep recent records in memory instead of writing, trigger dumps them into a file
+  size_t ring_capacity = 256 << 20;
+  GstClockTime ring_duration = 30 * GST_SECOND;
+  bool arrival = false; // Write time at which each buffer was handed over, for paced replay
+  bool asynchronous = false; // Write from a dedicated thread, handle_* calls only take references and queue entries
+  // NOTE: Concurrent mode is for streams pushed from their own threads: each stream stages entries in its own lock-free
+  //       queue and a merger thread writes them interleaved by time; overflow_policy applies to full staging queues
+  bool concurrent = false;
+  size_t staging_capacity = 1024; // Entries per stream, power of two
+  GstClockTime merge_latency = 50 * GST_MSECOND; // How long a stream with nothing staged can hold back the others
+  bool index = false; // Write key frame index and footer on close, for seeking on replay
+  bool compact = false; // Write buffers as compact records, with varint and delta encoded headers
+  bool checksum = false; // Follow records with their CRC32C, so that replay detects corruption and resynchronizes
+  // NOTE: Compression happens on the thread which writes, use together with asynchronous to keep it off push threads
+  Compression compression = Compression::None; // Pack records into independently compressed blocks
+  int compression_level = 3; // Zstandard only
+  size_t block_size = 1 << 20; // Uncompressed size at which a block is complete
+  GstClockTime index_interval = 250 * GST_MSECOND; // Minimal time between indexed key frames of a stream
+  size_t queue_capacity = 64 << 20;
+  OverflowPolicy overflow_policy = OverflowPolicy::Block;
+  std::atomic<uint64_t> queued_bytes = 0;
+  std::atomic<uint64_t> dropped_buffer_count = 0;
+  std::atomic<uint64_t> dropped_bytes = 0;
+
+  Output output;
+  std::thread writer_thread;
+  std::mutex queue_mutex;
+  std::condition_variable queue_condition;
+  std::condition_variable space_condition;
+  std::deque<Entry> queue;
+  bool termination = false;
+  std::atomic<StagingQueue*> staging_queue_list[256] {};
+  std::atomic<unsigned int> staging_generation = 0; // Incremented when a staging queue is added
+  std::atomic_bool merger_waiting = false; // Merger sleeps on queue_condition, staging threads take the lock to wake it
+  bool dropping_list[256] {};
+  bool discontinuity_list[256] {};
+  uint64_t caps_offset_list[256] {};
+  uint32_t caps_block_offset_list[256] {};
+  GstClockTime index_time_list[256] {};
+  std::vector<IndexEntry> index_entry_list;
+  std::vector<std::pair<uint8_t, uint16_t>> stream_table;
+  std::vector<std::string> caps_string_list;
+  std::map<std::string, uint16_t> caps_identifier_map;
+  GstCaps* caps_list[256] {}; // Most recent caps of the stream
+  uint16_t caps_identifier_list[256] {};
+  CompactState compact_state_list[256];
+  bool blocking = false; // Records go to block rather than straight to output
+  uint32_t record_checksum = 0; // Of the record being written, outside of blocks
+  std::vector<uint8_t> block;
+  std::vector<uint8_t> compressed_block;
+  std::vector<BlockEntry> block_entry_list;
+#if defined(WITH_ZSTD)
+  ZSTD_CCtx* zstd_context = nullptr;
+#endif
+  unsigned int segment_number = 0;
+  std::deque<std::string> segment_path_list; // Segments on disk, oldest first
+  GstClockTime segment_time = GST_CLOCK_TIME_NONE; // Time of first buffer in current segment
+  int key_element_identifier = -1; // Stream segments are aligned on, or -1
+  gint64 arrival_origin = 0; // Monotonic time arrival records are relative to, in microseconds
+  std::mutex ring_mutex;
+  std::deque<Entry> ring_entry_list;
+  std::deque<std::pair<uint64_t, GstClockTime>> ring_boundary_list; // Sequence number and time of key frame entries
+  uint64_t ring_sequence = 0; // Sequence number of first entry in ring_entry_list
+  uint64_t ring_bytes = 0;
+  GstClockTime ring_time = GST_CLOCK_TIME_NONE; // Time of most recent buffer
+  GstCaps* ring_caps_list[256] {}; // Caps of the stream at window start
+  std::thread dump_thread;
+  std::atomic_bool dumping = false;
 };
@@ -7,8 +7,12 @@
 
 #include <memory>
 #include <algorithm>
+#include <utility>
 #include <vector>
 #include <list>
+#include <deque>
+#include <map>
+#include <cstring>
 #include <string>
 #include <sstream>
 #if defined(STD_FILESYSTEM_EXPERIMENTAL)
@@ -24,36 +28,72 @@ using std::filesystem::path;
 #include <condition_variable>
 #include <thread>
 #include <chrono>
+#include <ctime>
 
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
 
-// NOTE: This is not really needed for replay, just a reference to the header which creates appsrc replay files
+// NOTE: The header which creates appsrc replay files, also defines layout of index and footer records
 #include "record.h"
 
-#if defined(WIN32) && !defined(NDEBUG)
+#if defined(WIN32)
 #  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <unistd.h>
 #endif
 
 #define GETTEXT_PACKAGE "gstreamer_appsrcsandbox"
 
 // Commandline option parser https://developer-old.gnome.org/glib/unstable/glib-Commandline-option-parser.html
 
-static gchar* g_path = nullptr;
+static gchar** g_path = nullptr;
 static gint g_video_mode = 0;
 static guint g_bin_count = 1;
 static guint g_video_bin_index = 0;
 static gboolean g_no_sync = false;
 static guint g_only_push_index = std::numeric_limits<guint>::max();
+static gdouble g_start = -1.0;
+static gdouble g_end = -1.0;
+static gboolean g_fast_start = false;
+static gboolean g_mmap = false;
+static gboolean g_no_pool = false;
+static gboolean g_no_verify = false;
+static gint g_pace = 0;
+static gdouble g_speed = 1.0;
+static gboolean g_benchmark = false;
+static guint g_loop_count = 1;
+static guint g_instance_count = 1;
+static guint g_queue_size = 4 << 20;
+static guint g_batch_count = 1;
+static guint g_batch_size = 256 << 10;
+static gdouble g_batch_time = 0.1;
+static gdouble g_queue_time = 2.0;
 
 static GOptionEntry g_option_context_entries[] {
-  { "path", 'p', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &g_path, "Path to input file to play back", nullptr },
+  { "path", 'p', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME_ARRAY, &g_path, "Path to input file to play back, repeated for one file per bin merged by DTS", nullptr },
   { "video-mode", 'v', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_video_mode, "Playbin video-sink mode (0 - default sink, 1 - I420 appsink, 2 - I420 capsfilter & appsink)", nullptr },
   { "bin-count", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_bin_count, "Number of bins in the pipeline and presumably in the supplied replay input", nullptr },
   { "video-bin-index", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_video_bin_index, "Index of video bin/stream in the multi-bin configuration", nullptr },
   { "no-sync", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_no_sync, "Remove sync mode from appsink instances", nullptr },
   { "only-push-index", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_only_push_index, "Replay buffers only on specified stream index", nullptr },
+  { "start", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_start, "Start replay of each stream from its key frame preceding given time in seconds (uses index if present, scans record headers otherwise)", nullptr },
+  { "end", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_end, "End replay of each stream at given time in seconds", nullptr },
+  { "fast-start", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_fast_start, "Drop leading delta unit buffers of each stream up to its first key frame, header buffers are kept", nullptr },
+  { "queue-size", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_queue_size, "Size in bytes of per-bin queues between file reading and per-bin push threads", nullptr },
+  { "queue-time", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_queue_time, "Stream time in seconds per-bin queues can read ahead (0 - bound by size only)", nullptr },
+  { "batch-count", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_batch_count, "Push up to given number of consecutive queued buffers of a bin in one buffer list (1 - push buffers one by one, ignored with --pace)", nullptr },
+  { "batch-size", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_batch_size, "Size in bytes a buffer list can grow to", nullptr },
+  { "batch-time", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_batch_time, "Stream time in seconds a buffer list can span", nullptr },
+  { "mmap", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_mmap, "Memory-map input file and push buffers wrapping mapped payloads, without copying", nullptr },
+  { "pace", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_pace, "Release buffers in real time (0 - as fast as need-data allows, 1 - at recorded arrival time, or DTS if not recorded, 2 - at DTS/PTS against pipeline clock)", nullptr },
+  { "speed", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_speed, "Pacing speed multiplier, e.g. 0.5, 2, 10", nullptr },
+  { "benchmark", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_benchmark, "Push as fast as possible with sync disabled on sinks, print per-bin throughput as JSON at exit (implies --video-mode 1 unless set)", nullptr },
+  { "loop", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_loop_count, "Replay input given number of times with timestamps rebased to continue monotonically (0 - forever)", nullptr },
+  { "instance-count", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_INT, &g_instance_count, "Number of independent pipelines replaying the input concurrently from one shared mapping of the file (implies --mmap)", nullptr },
+  { "no-pool", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_no_pool, "Allocate every replayed buffer anew instead of recycling payload memory", nullptr },
+  { "no-verify", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &g_no_verify, "Step over record checksums instead of verifying them, corrupt data is then not detected", nullptr },
   { nullptr }
 };
 
@@ -69,8 +109,54 @@ void set_pipeline_state (GstPipeline* pipeline, GstState state)
     g_assert_true (gst_element_get_state (GST_ELEMENT_CAST (pipeline), nullptr, nullptr, GST_CLOCK_TIME_NONE) != GST_STATE_CHANGE_FAILURE);
 }
 
+// NOTE: CPU time of the calling thread, or of the whole process, in microseconds
+gint64 get_cpu_time (bool thread)
+{
+#if defined(WIN32)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  const auto result = thread ? GetThreadTimes (GetCurrentThread (), &creation_time, &exit_time, &kernel_time, &user_time) : GetProcessTimes (GetCurrentProcess (), &creation_time, &exit_time, &kernel_time, &user_time);
+  if (!result)
+    return 0;
+  const auto get = [] (const FILETIME& time) { return static_cast<gint64> ((static_cast<uint64_t> (time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10; };
+  return get (kernel_time) + get (user_time);
+#else
+  timespec time;
+  if (clock_gettime (thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &time) != 0)
+    return 0;
+  return static_cast<gint64> (time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+#endif
+}
+
+// NOTE: Resident memory of the process in bytes, 0 if not available
+uint64_t get_resident_size ()
+{
+#if defined(WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof counters))
+    return 0;
+  return counters.WorkingSetSize;
+#else
+  std::ifstream stream ("/proc/self/statm");
+  uint64_t size, resident_size;
+  if (!(stream >> size >> resident_size))
+    return 0;
+  return resident_size * static_cast<uint64_t> (sysconf (_SC_PAGESIZE));
+#endif
+}
+
+// NOTE: Record file reading, included past the debug category definition to log into the application category
+#include "reader.h"
+
 struct Application {
   struct Bin {
+    struct Item {
+      uint8_t type; // 1 - caps, 2 - buffer, 3 - end of stream
+      GstCaps* caps;
+      GstBuffer* buffer;
+      size_t size;
+      GstClockTime pace_time = GST_CLOCK_TIME_NONE; // Recorded arrival or timestamp to pace the buffer with
+    };
+
     void create_playbin ()
     {
       playbin = gst_element_factory_make ("playbin", nullptr); // https://gstreamer.freedesktop.org/documentation/playback/playbin.html#properties
@@ -156,22 +242,171 @@ struct Application {
     void handle_source_setup (GstElement* element)
     {
       GST_INFO_OBJECT (element, "%u: handle_source_setup, %s", index, GST_ELEMENT_NAME (element));
-      source = GST_APP_SRC (element);
-      gst_object_ref (GST_OBJECT_CAST (source));
-      g_object_set (source, // https://gstreamer.freedesktop.org/documentation/app/appsrc.html?gi-language=c
+      gst_object_ref (GST_OBJECT_CAST (element));
+      g_object_set (element, // https://gstreamer.freedesktop.org/documentation/app/appsrc.html?gi-language=c
           "max-bytes", static_cast<guint64> (2 << 20),
           "min-percent", static_cast<guint> (50),
           nullptr);
-      g_object_set (source, "format", GST_FORMAT_TIME, nullptr);
-      g_signal_connect (source, "enough-data", G_CALLBACK (+[] (GstElement* Element, Bin* bin) { bin->handle_enough_data (); }), this);
-      g_signal_connect (source, "need-data", G_CALLBACK (+[] (GstElement* Element, guint DataSize, Bin* bin) { bin->handle_need_data (); }), this);
+      g_object_set (element, "format", GST_FORMAT_TIME, nullptr);
+      g_signal_connect (element, "enough-data", G_CALLBACK (+[] (GstElement* Element, Bin* bin) { bin->handle_enough_data (); }), this);
+      g_signal_connect (element, "need-data", G_CALLBACK (+[] (GstElement* Element, guint DataSize, Bin* bin) { bin->handle_need_data (); }), this);
       source_data_need.store (true);
+      // NOTE: Wakes up replay waiting for all sources to show up
+      std::unique_lock source_lock (application->source_mutex);
+      source = GST_APP_SRC (element);
+      application->source_condition.notify_all ();
     }
     void handle_element_setup (GstElement* element)
     {
       GST_INFO_OBJECT (element, "%u: handle_element_setup, %s", index, GST_ELEMENT_NAME (element));
     }
 
+    void set_caps (GstCaps* caps)
+    {
+      GST_INFO ("%u: gst_app_src_set_caps: %" GST_PTR_FORMAT, index, caps);
+      gst_app_src_set_caps (source, caps);
+    }
+    // NOTE: Push thread of the bin, drains the bin's queue and waits for need-data of its own source only; waiting
+    //       for reading while the source needs data is accounted as starvation
+    //       With batching, consecutive buffers already queued go out together in one buffer list, taking one need-data
+    //       wait and one push call; no wait for more buffers to show up
+    void push (std::atomic_bool& termination)
+    {
+      const auto batching = g_batch_count > 1 && !g_pace;
+      const auto batch_time = static_cast<GstClockTime> (g_batch_time * GST_SECOND);
+      std::vector<GstBuffer*> batch;
+      for (;;) {
+        Item item;
+        {
+          std::unique_lock queue_lock (application->queue_mutex);
+          const auto starving = queue.empty () && queue_started && !queue_end && source_data_need.load ();
+          const auto time = starving ? g_get_monotonic_time () : 0;
+          application->queue_condition.wait (queue_lock, [&] { return !queue.empty () || queue_end || termination.load (); });
+          if (starving) {
+            starvation_count++;
+            starvation_time += g_get_monotonic_time () - time;
+          }
+          if (queue.empty () || termination.load ())
+            break;
+          item = queue.front ();
+          queue.pop_front ();
+          queue_size -= item.size;
+          if (item.type == 2 && batching) {
+            const auto time = GST_BUFFER_DTS_OR_PTS (item.buffer);
+            auto size = gst_buffer_get_size (item.buffer);
+            batch.push_back (item.buffer);
+            for (; !queue.empty () && queue.front ().type == 2 && batch.size () < g_batch_count; queue.pop_front ()) {
+              const auto& next_item = queue.front ();
+              const auto next_size = gst_buffer_get_size (next_item.buffer);
+              const auto next_time = GST_BUFFER_DTS_OR_PTS (next_item.buffer);
+              if (size + next_size > g_batch_size)
+                break;
+              if (GST_CLOCK_TIME_IS_VALID (time) && GST_CLOCK_TIME_IS_VALID (next_time) && next_time > time + batch_time)
+                break;
+              batch.push_back (next_item.buffer);
+              size += next_size;
+              queue_size -= next_item.size;
+            }
+          }
+          application->queue_condition.notify_all ();
+        }
+        switch (item.type) {
+          case 1:
+            set_caps (item.caps);
+            gst_caps_unref (item.caps);
+            break;
+          case 2: {
+            if (!g_pace || !wait_pace (item.pace_time, termination)) {
+              std::unique_lock source_data_lock (source_data_mutex);
+              source_data_condition.wait (source_data_lock, [&] { return source_data_need.load () || termination.load (); });
+            }
+            const auto time = g_get_monotonic_time ();
+            GstFlowReturn result;
+            if (batch.size () > 1) {
+              GST_INFO ("%u: gst_app_src_push_buffer_list: %zu buffers from %s", index, batch.size (), buffer_to_string (batch.front ()).c_str ());
+              const auto buffer_list = gst_buffer_list_new_sized (static_cast<guint> (batch.size ()));
+              for (auto&& buffer : batch) {
+                push_size += gst_buffer_get_size (buffer);
+                gst_buffer_list_add (buffer_list, buffer);
+              }
+              push_count += batch.size ();
+              result = gst_app_src_push_buffer_list (source, buffer_list);
+            } else {
+              GST_INFO ("%u: gst_app_src_push_buffer: %s", index, buffer_to_string (item.buffer).c_str ());
+              push_count++;
+              push_size += gst_buffer_get_size (item.buffer);
+              result = gst_app_src_push_buffer (source, item.buffer);
+            }
+            g_assert_true (result == GstFlowReturn::GST_FLOW_OK);
+            batch.clear ();
+            push_end_time = g_get_monotonic_time ();
+            if (!push_call_count)
+              first_push_time = push_end_time;
+            push_call_count++;
+            push_call_time += push_end_time - time;
+          } break;
+          case 3:
+            GST_INFO ("%u: gst_app_src_end_of_stream", index);
+            gst_app_src_end_of_stream (source);
+            end_of_stream = true;
+            break;
+          default:
+            g_assert_not_reached ();
+        }
+      }
+      {
+        std::unique_lock queue_lock (application->queue_mutex);
+        for (auto&& item : queue) {
+          if (item.caps)
+            gst_caps_unref (item.caps);
+          if (item.buffer)
+            gst_buffer_unref (item.buffer);
+        }
+        queue.clear ();
+        queue_size = 0;
+        application->queue_condition.notify_all ();
+      }
+      if (g_video_mode != 0 && !end_of_stream) {
+        GST_INFO ("%u: gst_app_src_end_of_stream", index);
+        gst_app_src_end_of_stream (source);
+      }
+      push_cpu_time = get_cpu_time (true);
+    }
+    // NOTE: Waits until the buffer is due at base time plus its running time scaled by speed, taken from the first
+    //       buffer of the replay with --pace 1 and from the segment of appsrc with --pace 2; need-data is ignored the
+    //       way a live producer would, late buffers go out right away. False until PLAYING hands out the pipeline
+    //       clock, buffers are pushed on need-data to preroll until then
+    bool wait_pace (GstClockTime time, std::atomic_bool& termination)
+    {
+      const auto clock = gst_element_get_clock (GST_ELEMENT_CAST (application->pipeline));
+      if (!clock)
+        return false;
+      const auto origin = g_pace == 2 ? 0 : application->pace_origin;
+      const auto clock_time = gst_clock_get_time (clock);
+      gst_object_unref (clock);
+      if (!GST_CLOCK_TIME_IS_VALID (time) || !GST_CLOCK_TIME_IS_VALID (origin) || time < origin)
+        return true;
+      const auto target = gst_element_get_base_time (GST_ELEMENT_CAST (application->pipeline)) + static_cast<GstClockTime> ((time - origin) / g_speed);
+      if (target <= clock_time)
+        return true;
+      std::unique_lock source_data_lock (source_data_mutex);
+      source_data_condition.wait_for (source_data_lock, std::chrono::nanoseconds (target - clock_time), [&] { return termination.load (); });
+      return true;
+    }
+    // NOTE: Time span of queued buffers if the item was added
+    GstClockTime get_queue_time (const Item& item) const
+    {
+      const auto item_time = item.buffer ? GST_BUFFER_DTS_OR_PTS (item.buffer) : GST_CLOCK_TIME_NONE;
+      if (!GST_CLOCK_TIME_IS_VALID (item_time))
+        return 0;
+      for (auto&& queue_item : queue) {
+        const auto time = queue_item.buffer ? GST_BUFFER_DTS_OR_PTS (queue_item.buffer) : GST_CLOCK_TIME_NONE;
+        if (GST_CLOCK_TIME_IS_VALID (time))
+          return item_time > time ? item_time - time : 0;
+      }
+      return 0;
+    }
+
     void handle_enough_data ()
     {
       GST_WARNING ("%u: handle_enough_data", index);
@@ -184,9 +419,14 @@ struct Application {
     {
       GST_WARNING ("%u: handle_need_data", index);
       // GST_DEBUG_BIN_TO_DOT_FILE (GST_BIN_CAST (pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "gstreamer_appsrcsandbox-handle_need_data");
-      std::unique_lock source_data_lock (source_data_mutex);
-      source_data_need.store (true);
-      source_data_condition.notify_all ();
+      {
+        std::unique_lock source_data_lock (source_data_mutex);
+        source_data_need.store (true);
+        source_data_condition.notify_all ();
+      }
+      // NOTE: Reading held back by the queue budget may go on now that this bin starves, see Application::enqueue
+      std::unique_lock queue_lock (application->queue_mutex);
+      application->queue_condition.notify_all ();
     }
 
     GstFlowReturn handle_sink_preroll_sample (GstAppSink* sink)
@@ -199,6 +439,8 @@ struct Application {
           break;
         GST_INFO_OBJECT (sample, "%u: handle_sink_preroll_sample: %s", index, sample_text (sample).c_str ());
         gst_sample_unref (sample);
+        gint64 time = 0;
+        first_frame_time.compare_exchange_strong (time, g_get_monotonic_time ());
       }
       return GstFlowReturn::GST_FLOW_OK;
     }
@@ -211,13 +453,32 @@ struct Application {
         if (!sample)
           break;
         GST_INFO_OBJECT (sample, "%u: handle_sink_sample: %s", index, sample_text (sample).c_str ());
+        // NOTE: A frame misses its deadline when it reaches the sink past the running time its display ends at, without sync there is no deadline
+        const auto buffer = gst_sample_get_buffer (sample);
+        const auto segment = gst_sample_get_segment (sample);
+        const auto clock = g_no_sync ? nullptr : gst_element_get_clock (GST_ELEMENT_CAST (sink));
+        if (buffer && segment && clock && GST_BUFFER_PTS_IS_VALID (buffer)) {
+          const auto running_time = gst_segment_to_running_time (segment, GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+          const auto clock_running_time = gst_clock_get_time (clock) - gst_element_get_base_time (GST_ELEMENT_CAST (sink));
+          if (GST_CLOCK_TIME_IS_VALID (running_time) && clock_running_time > running_time + (GST_BUFFER_DURATION_IS_VALID (buffer) ? GST_BUFFER_DURATION (buffer) : 0))
+            deadline_miss_count++;
+        }
+        if (clock)
+          gst_object_unref (clock);
         gst_sample_unref (sample);
+        const auto time = g_get_monotonic_time ();
+        if (!sample_count++)
+          first_sample_time = time;
+        gint64 no_time = 0;
+        first_frame_time.compare_exchange_strong (no_time, time);
+        last_sample_time = time;
       }
       return GstFlowReturn::GST_FLOW_OK;
     }
     void handle_sink_eos (GstAppSink* sink)
     {
       GST_INFO_OBJECT (sink, "%u: handle_sink_eos", index);
+      end_of_stream_time = g_get_monotonic_time ();
     }
 
     Application* application;
@@ -229,6 +490,41 @@ struct Application {
     std::atomic_bool source_data_need;
     bool end_of_stream = false;
     GstAppSink* sink = nullptr;
+    std::thread push_thread;
+    std::deque<Item> queue; // Guarded by Application::queue_mutex, as well as the fields below
+    size_t queue_size = 0;
+    bool queue_started = false; // Something was queued
+    bool queue_closed = false; // End of stream was queued
+    bool queue_fed = false; // Buffers were queued in this pass and more may follow (not past --end)
+    bool queue_end = false; // File reading completed
+    guint starvation_count = 0; // Push thread waited for reading while the source needed data
+    gint64 starvation_time = 0; // Microseconds
+    guint hold_count = 0; // Reading waited for the queue to free up
+    gint64 hold_time = 0;
+    uint64_t skip_count = 0; // Leading buffers dropped before the key frame the stream starts with
+    uint64_t skip_size = 0;
+    GstClockTime skip_time = 0; // Stream time
+    // NOTE: Benchmark counters, times are monotonic in microseconds; sink ones are updated from streaming threads
+    uint64_t push_count = 0;
+    uint64_t push_size = 0;
+    gint64 first_push_time = 0;
+    gint64 push_end_time = 0;
+    gint64 push_cpu_time = 0; // Of the push thread
+    uint64_t push_call_count = 0; // Push calls, fewer than buffers with batching
+    gint64 push_call_time = 0;
+    std::atomic<uint64_t> sample_count = 0;
+    std::atomic<gint64> first_sample_time = 0;
+    std::atomic<gint64> first_frame_time = 0; // Preroll or sample
+    std::atomic<uint64_t> deadline_miss_count = 0;
+    std::atomic<gint64> last_sample_time = 0;
+    std::atomic<gint64> end_of_stream_time = 0;
+  };
+
+  struct Throughput {
+    double buffer_rate = 0; // Per second
+    double byte_rate = 0;
+    double frame_rate = 0;
+    uint64_t deadline_miss_count = 0;
   };
 
   Application () = default;
@@ -240,25 +536,8 @@ struct Application {
 
   static std::string buffer_flags_to_string (guint flags)
   {
-    static const std::initializer_list<std::pair<guint, const char*>> g_list { // clang-format off
-      #define IDENTIFIER(Name) std::make_pair<guint, const char*>(Name, #Name),
-      IDENTIFIER (GST_BUFFER_FLAG_LIVE)
-      IDENTIFIER (GST_BUFFER_FLAG_DECODE_ONLY)
-      IDENTIFIER (GST_BUFFER_FLAG_DISCONT)
-      IDENTIFIER (GST_BUFFER_FLAG_RESYNC)
-      IDENTIFIER (GST_BUFFER_FLAG_CORRUPTED)
-      IDENTIFIER (GST_BUFFER_FLAG_MARKER)
-      IDENTIFIER (GST_BUFFER_FLAG_HEADER)
-      IDENTIFIER (GST_BUFFER_FLAG_GAP)
-      IDENTIFIER (GST_BUFFER_FLAG_DROPPABLE)
-      IDENTIFIER (GST_BUFFER_FLAG_DELTA_UNIT)
-      IDENTIFIER (GST_BUFFER_FLAG_TAG_MEMORY)
-      IDENTIFIER (GST_BUFFER_FLAG_SYNC_AFTER)
-      IDENTIFIER (GST_BUFFER_FLAG_NON_DROPPABLE)
-      #undef IDENTIFIER
-    }; // clang-format on
     std::ostringstream stream;
-    for (auto&& element : g_list)
+    for (auto&& element : get_buffer_flag_list ())
       if (flags & element.first)
         stream << " | " << element.second;
     auto string = stream.str ();
@@ -287,107 +566,415 @@ struct Application {
     }
     return stream.str ();
   }
-  void push (std::atomic_bool& termination, std::string path)
+  // NOTE: Records of a single input go to the bin of their stream; with several inputs, one recording per bin, all
+  //       records of input N go to bin N and inputs are merged by DTS
+  void push (std::atomic_bool& termination, std::list<Reader>& reader_list)
   {
-    std::ifstream stream;
-    stream.open (path, std::ios_base::in | std::ios_base::binary);
-    g_assert_true (stream);
-    for (; !termination.load ();) {
-      if (std::all_of (bin_list.cbegin (), bin_list.cend (), [&] (auto&& bin) { return bin.source != nullptr; }))
-        break;
-      std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    {
+      std::unique_lock source_lock (source_mutex);
+      source_condition.wait (source_lock, [&] { return termination.load () || std::all_of (bin_list.cbegin (), bin_list.cend (), [&] (auto&& bin) { return bin.source != nullptr; }); });
     }
+    const auto get_bin = [&] (size_t index) -> Bin& {
+      auto iterator = bin_list.begin ();
+      std::advance (iterator, index);
+      return *iterator;
+    };
+    struct Input {
+      Reader& reader;
+      size_t index;
+      Reader::Start start;
+      Reader::Record record; // Next record of the input, read ahead for merging
+      bool pending = false;
+      bool completed = false;
+      GstClockTime time = 0; // Last valid DTS/PTS read, merge time of following buffers without timestamps
+    };
+    std::list<Input> input_list;
+    for (auto&& reader : reader_list)
+      input_list.push_back ({ reader, input_list.size (), { std::make_pair (reader.data_offset, static_cast<uint32_t> (0)) } });
+    const auto get_index = [&] (const Input& input, uint8_t element_identifier) -> size_t { return input_list.size () > 1 ? input.index : element_identifier; };
+    // NOTE: Caps each bin starts with, applied again when a further loop starts over; bins with a declared stream
+    //       are waited for to pass --end before reading stops early
+    std::vector<GstCaps*> start_caps_list (bin_list.size (), nullptr);
+    std::vector<bool> declared_list (bin_list.size (), false);
+    for (auto&& input : input_list)
+      for (auto&& element : input.reader.stream_table) {
+        const auto index = get_index (input, element.first);
+        if (index >= bin_list.size ())
+          continue;
+        declared_list[index] = true;
+        if (const auto caps = input.reader.get_caps (element.second))
+          start_caps_list[index] = caps;
+      }
+    // NOTE: Each stream starts with its key frame at or before the start time (or with its first key frame in fast
+    //       start mode), buffers of the stream in front of it are dropped
+    std::vector<Reader::StartFilter> start_filter_list (bin_list.size (), { g_start >= 0 || g_fast_start });
+    if (g_start >= 0)
+      for (auto&& input : input_list) {
+        input.start = input.reader.find_start (static_cast<GstClockTime> (g_start * GST_SECOND), [&] (uint8_t element_identifier) { return get_index (input, element_identifier) < bin_list.size (); });
+        for (auto&& key_frame : input.start.key_frame_list) {
+          const auto index = get_index (input, key_frame.element_identifier);
+          if (key_frame.caps)
+            start_caps_list[index] = key_frame.caps;
+          start_filter_list[index].key_frame_time = key_frame.time;
+        }
+        if (!input.start.key_frame_list.empty ())
+          GST_INFO ("%zu: starting from offset %" G_GUINT64_FORMAT "+%u for time %.3f", input.index, input.start.position.first, input.start.position.second, g_start);
+        else
+          GST_WARNING ("%zu: no key frames found, replaying from the beginning", input.index);
+      }
+    const auto seek_start = [&] (Input& input) {
+      input.reader.seek_start (input.start);
+      input.pending = false;
+      input.completed = false;
+      input.time = 0;
+    };
+    for (auto&& input : input_list)
+      seek_start (input);
+    for (size_t index = 0; index < start_caps_list.size (); index++)
+      if (start_caps_list[index])
+        get_bin (index).set_caps (start_caps_list[index]);
     GST_INFO ("Before pushing data");
+    if (g_pace)
+      g_assert_true (g_speed > 0);
+    start_time = g_get_monotonic_time ();
+    start_cpu_time = get_cpu_time (false);
+    for (auto&& bin : bin_list)
+      bin.push_thread = std::thread ([&] { bin.push (termination); });
+    // NOTE: K-way merge with one record read ahead per input, which bounds memory per input: caps and end of stream
+    //       records go first, then the buffer with the lowest DTS, PTS if there is no DTS; buffers with neither keep
+    //       the place of the last buffer of their input that had one
+    const auto next = [&] () -> Input* {
+      Input* next_input = nullptr;
+      GstClockTime next_time = 0;
+      for (auto&& input : input_list) {
+        if (!input.pending && !input.completed) {
+          input.pending = input.reader.next (input.record);
+          input.completed = !input.pending;
+        }
+        if (!input.pending)
+          continue;
+        auto time = static_cast<GstClockTime> (0);
+        if (input.record.type == 2) {
+          const auto record_time = static_cast<GstClockTime> (input.record.dts != -1 ? input.record.dts : input.record.pts);
+          if (GST_CLOCK_TIME_IS_VALID (record_time))
+            input.time = record_time;
+          time = input.time;
+        }
+        if (!next_input || time < next_time) {
+          next_input = &input;
+          next_time = time;
+        }
+      }
+      if (next_input)
+        next_input->pending = false;
+      return next_input;
+    };
     std::once_flag stream_warnning;
-    for (; !termination.load () && !stream.eof ();) {
-      uint8_t type;
-      stream.read (reinterpret_cast<char*> (&type), sizeof type);
-      if (stream.fail ())
-        break;
-      uint8_t index;
-      stream.read (reinterpret_cast<char*> (&index), sizeof index);
-      if (stream.fail ())
-        break;
-      if (index >= bin_list.size ()) {
-        std::call_once (stream_warnning, [&] {
-          GST_ERROR ("Trying to play packet for stream %u in %zu-bin configuration, use --bin-count", index, bin_list.size ());
-        });
-        continue;
+    // NOTE: Every further loop reads the same records again, from the same reader with caps already parsed and the
+    //       mapping in place; timestamps and pace times are shifted by the span the first loop covered, so that they
+    //       continue monotonically, and end of stream is only passed on in the last loop
+    std::pair<GstClockTime, GstClockTime> time_span { GST_CLOCK_TIME_NONE, 0 }, pace_span { GST_CLOCK_TIME_NONE, 0 };
+    const auto extend = [] (std::pair<GstClockTime, GstClockTime>& span, GstClockTime time, GstClockTime end_time) {
+      if (!GST_CLOCK_TIME_IS_VALID (time))
+        return;
+      span.first = GST_CLOCK_TIME_IS_VALID (span.first) ? std::min (span.first, time) : time;
+      span.second = std::max (span.second, end_time);
+    };
+    const auto get_length = [] (const std::pair<GstClockTime, GstClockTime>& span) -> GstClockTime { return GST_CLOCK_TIME_IS_VALID (span.first) ? span.second - span.first : 0; };
+    for (guint loop_index = 0; !termination.load (); loop_index++) {
+      const auto last_loop = g_loop_count && loop_index + 1 >= g_loop_count;
+      if (loop_index) {
+        for (auto&& input : input_list)
+          seek_start (input);
+        for (size_t index = 0; index < start_caps_list.size (); index++)
+          if (start_caps_list[index])
+            enqueue (get_bin (index), Bin::Item { 1, gst_caps_ref (start_caps_list[index]), nullptr, 64 }, termination);
       }
-      auto iterator = bin_list.begin ();
-      std::advance (iterator, index);
-      auto& bin = *iterator;
-      g_assert_nonnull (bin.source);
-      switch (type) {
-        case 1: {
-          uint16_t size;
-          stream.read (reinterpret_cast<char*> (&size), sizeof size);
-          std::string caps_string;
-          if (size) {
-            caps_string.resize (size);
-            stream.read (reinterpret_cast<char*> (caps_string.data ()), caps_string.size ());
-          }
-          GstCaps* caps = gst_caps_from_string (caps_string.c_str ());
-          GST_INFO ("%u: gst_app_src_set_caps: %s", bin.index, caps_string.c_str ());
-#if 0
-          {
-            gst_caps_set_simple (caps, "stream-format", G_TYPE_STRING, "byte-stream", nullptr);
-            gchar* caps_string = gst_caps_to_string (caps);
-            GST_INFO ("%u: gst_app_src_set_caps: %s", index, caps_string);
-            g_free (caps_string);
-          }
-#endif
-          gst_app_src_set_caps (bin.source, caps);
-          gst_caps_unref (caps);
-        } break;
-        case 2: {
-          uint64_t flags;
-          int64_t dts;
-          int64_t pts;
-          int64_t duration;
-          stream.read (reinterpret_cast<char*> (&flags), sizeof flags);
-          stream.read (reinterpret_cast<char*> (&dts), sizeof dts);
-          stream.read (reinterpret_cast<char*> (&pts), sizeof pts);
-          stream.read (reinterpret_cast<char*> (&duration), sizeof duration);
-          uint32_t size;
-          stream.read (reinterpret_cast<char*> (&size), sizeof size);
-          std::vector<uint8_t> data;
-          data.resize (size);
-          stream.read (reinterpret_cast<char*> (data.data ()), data.size ());
-          if (g_only_push_index == std::numeric_limits<guint>::max () || g_only_push_index == index) {
-            GstBuffer* buffer = gst_buffer_new_allocate (nullptr, size, nullptr);
-            GST_BUFFER_FLAGS (buffer) = static_cast<guint> (flags);
-            GST_BUFFER_DTS (buffer) = static_cast<GstClockTime> (dts);
-            GST_BUFFER_PTS (buffer) = static_cast<GstClockTime> (pts);
-            GST_BUFFER_DURATION (buffer) = static_cast<GstClockTime> (duration);
-            gst_buffer_fill (buffer, 0, data.data (), data.size ());
-            {
-              std::unique_lock source_data_lock (bin.source_data_mutex);
-              bin.source_data_condition.wait (source_data_lock, [&] { return bin.source_data_need.load () || termination.load (); });
+      const auto time_offset = loop_index * get_length (time_span);
+      const auto pace_offset = loop_index * get_length (pace_span);
+      Loop loop { g_get_monotonic_time () };
+      {
+        std::unique_lock queue_lock (queue_mutex);
+        for (auto&& bin : bin_list)
+          bin.queue_fed = false;
+      }
+      auto loop_start_filter_list = start_filter_list;
+      std::vector<GstClockTime> skip_time_list (bin_list.size (), GST_CLOCK_TIME_NONE);
+      std::vector<bool> end_list (bin_list.size (), false);
+      size_t end_count = 0;
+      auto stream_list = declared_list; // Bins with a stream, declared or seen in this pass
+      auto stream_count = static_cast<size_t> (std::count (stream_list.cbegin (), stream_list.cend (), true));
+      for (Input* input; !termination.load () && (input = next ());) {
+        auto& reader = input->reader;
+        auto& record = input->record;
+        const auto index = get_index (*input, record.element_identifier);
+        if (index >= bin_list.size ()) {
+          std::call_once (stream_warnning, [&] {
+            GST_ERROR ("Trying to play packet for stream %zu in %zu-bin configuration, use --bin-count", index, bin_list.size ());
+          });
+          continue;
+        }
+        if (!stream_list[index]) {
+          stream_list[index] = true;
+          stream_count++;
+        }
+        auto& bin = get_bin (index);
+        g_assert_nonnull (bin.source);
+        Bin::Item item { record.type, nullptr, nullptr, 64 };
+        switch (record.type) {
+          case 1:
+            item.caps = gst_caps_ref (record.caps);
+            break;
+          case 2: {
+            if (g_only_push_index != std::numeric_limits<guint>::max () && g_only_push_index != index)
+              continue;
+            const auto time = static_cast<GstClockTime> (record.dts != -1 ? record.dts : record.pts);
+            auto& start_filter = loop_start_filter_list[index];
+            if (start_filter.pending) {
+              if (start_filter.skip (record)) {
+                bin.skip_count++;
+                bin.skip_size += record.buffer ? gst_buffer_get_size (record.buffer) : record.mapped_data ? record.mapped_size : record.data.size ();
+                if (!GST_CLOCK_TIME_IS_VALID (skip_time_list[index]))
+                  skip_time_list[index] = time;
+                continue;
+              }
+              if (!start_filter.pending && GST_CLOCK_TIME_IS_VALID (skip_time_list[index]) && GST_CLOCK_TIME_IS_VALID (time) && time > skip_time_list[index])
+                bin.skip_time += time - skip_time_list[index];
             }
-            GST_INFO ("%u: gst_app_src_push_buffer: %s", bin.index, buffer_to_string (buffer).c_str ());
-            const auto result = gst_app_src_push_buffer (bin.source, buffer);
-            g_assert_true (result == GstFlowReturn::GST_FLOW_OK);
-          }
-        } break;
-        case 3: {
-          GST_INFO ("%u: gst_app_src_end_of_stream", bin.index);
-          gst_app_src_end_of_stream (bin.source);
-          bin.end_of_stream = true;
-        } break;
-        default:
-          g_assert_not_reached ();
+            // NOTE: The stream ends with its first buffer at or past the end time, the rest of it is skipped
+            if (g_end >= 0 && GST_CLOCK_TIME_IS_VALID (time) && time >= static_cast<GstClockTime> (g_end * GST_SECOND)) {
+              if (end_list[index])
+                continue;
+              end_list[index] = true;
+              end_count++;
+              {
+                std::unique_lock queue_lock (queue_mutex);
+                bin.queue_fed = false;
+              }
+              if (!last_loop)
+                continue;
+              item.type = 3;
+              break;
+            }
+            GstBuffer* buffer;
+            if (record.buffer)
+              buffer = std::exchange (record.buffer, nullptr);
+            else if (record.mapped_data)
+              buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, const_cast<uint8_t*> (record.mapped_data), record.mapped_size, 0, record.mapped_size, reader.mapping->ref (), &Mapping::unref);
+            else {
+              buffer = gst_buffer_new_allocate (nullptr, record.data.size (), nullptr);
+              gst_buffer_fill (buffer, 0, record.data.data (), record.data.size ());
+            }
+            GST_BUFFER_FLAGS (buffer) = static_cast<guint> (record.flags);
+            GST_BUFFER_DTS (buffer) = static_cast<GstClockTime> (record.dts);
+            GST_BUFFER_PTS (buffer) = static_cast<GstClockTime> (record.pts);
+            GST_BUFFER_DURATION (buffer) = static_cast<GstClockTime> (record.duration);
+            item.buffer = buffer;
+            item.size += gst_buffer_get_size (buffer);
+            // NOTE: Arrival pacing starts with the first buffer read, shared by all bins; DTS pacing follows the
+            //       running time of the shifted timestamps
+            item.pace_time = g_pace == 1 && GST_CLOCK_TIME_IS_VALID (record.arrival) ? record.arrival : GST_BUFFER_DTS_OR_PTS (buffer);
+            if (loop_index == 0) {
+              const auto duration = GST_BUFFER_DURATION_IS_VALID (buffer) ? GST_BUFFER_DURATION (buffer) : 0;
+              const auto end_time = std::max (GST_BUFFER_DTS_IS_VALID (buffer) ? GST_BUFFER_DTS (buffer) : 0, GST_BUFFER_PTS_IS_VALID (buffer) ? GST_BUFFER_PTS (buffer) : 0) + duration;
+              extend (time_span, GST_BUFFER_DTS_OR_PTS (buffer), end_time);
+              extend (pace_span, item.pace_time, item.pace_time + duration);
+            } else {
+              if (GST_BUFFER_DTS_IS_VALID (buffer))
+                GST_BUFFER_DTS (buffer) += time_offset;
+              if (GST_BUFFER_PTS_IS_VALID (buffer))
+                GST_BUFFER_PTS (buffer) += time_offset;
+              if (GST_CLOCK_TIME_IS_VALID (item.pace_time))
+                item.pace_time += pace_offset;
+            }
+            if (g_pace == 2)
+              item.pace_time = GST_BUFFER_DTS_OR_PTS (buffer);
+            loop.buffer_count++;
+            loop.size += gst_buffer_get_size (buffer);
+            if (g_pace == 1 && !GST_CLOCK_TIME_IS_VALID (pace_origin) && GST_CLOCK_TIME_IS_VALID (item.pace_time))
+              pace_origin = item.pace_time;
+          } break;
+          case 3:
+            if (!last_loop || end_list[index])
+              continue;
+            break;
+          default:
+            g_assert_not_reached ();
+        }
+        enqueue (bin, std::move (item), termination);
+        // NOTE: Bins --bin-count adds beyond the streams of the input never reach the end time
+        if (end_count && end_count == stream_count)
+          break;
+      }
+      loop.time = g_get_monotonic_time () - loop.time;
+      loop.resident_size = get_resident_size ();
+      if (const auto pool = reader_list.front ().pool) {
+        std::unique_lock lock (pool->mutex);
+        loop.pool_outstanding_size = pool->outstanding_size;
+      }
+      if (g_loop_count != 1 && !g_benchmark)
+        g_print ("Loop %u: %.3f s, %" G_GUINT64_FORMAT " buffers, %.1f MB/s, resident %.1f MB, pool %.1f MB outstanding\n", loop_index, loop.time / 1E6, loop.buffer_count, loop.time ? loop.size / static_cast<double> (loop.time) : 0.0, loop.resident_size / 1E6, loop.pool_outstanding_size / 1E6);
+      loop_list.emplace_back (loop);
+      if (last_loop)
+        break;
+      if (!loop.buffer_count) {
+        GST_ERROR ("No buffers read in loop %u, stopping", loop_index);
+        break;
       }
     }
+    GST_INFO ("After reading data");
+    {
+      std::unique_lock queue_lock (queue_mutex);
+      for (auto&& bin : bin_list)
+        bin.queue_end = true;
+      queue_condition.notify_all ();
+    }
+    for (auto&& bin : bin_list)
+      bin.push_thread.join ();
     GST_INFO ("After pushing data");
-    if (g_video_mode != 0) {
-      for (auto&& bin : bin_list) {
-        if (!bin.end_of_stream) {
-          GST_INFO ("%u: gst_app_src_end_of_stream", bin.index);
-          gst_app_src_end_of_stream (bin.source);
-        }
+    // NOTE: Starved push threads indicate replay bound by reading, held back reading indicates replay bound by the
+    //       pipeline
+    if (g_benchmark || g_instance_count > 1)
+      return;
+    // NOTE: Startup latency, from launch to the first buffer pushed and to the first sample out of the sink
+    for (auto&& bin : bin_list)
+      g_print ("%u: first push after %.3f s, first sample after %.3f s, first frame %.3f s after PLAYING\n", bin.index, bin.first_push_time ? (bin.first_push_time - launch_time) / 1E6 : -1.0, bin.first_sample_time.load () ? (bin.first_sample_time.load () - launch_time) / 1E6 : -1.0, bin.first_frame_time.load () && play_time ? (bin.first_frame_time.load () - play_time) / 1E6 : -1.0);
+    if (g_start >= 0 || g_fast_start)
+      for (auto&& bin : bin_list)
+        g_print ("%u: skipped %" G_GUINT64_FORMAT " buffers, %" G_GUINT64_FORMAT " bytes, %.3f s before key frame\n", bin.index, bin.skip_count, bin.skip_size, bin.skip_time / 1E9);
+    for (auto&& bin : bin_list)
+      g_print ("%u: push starved %u times for %.3f s, reading held back %u times for %.3f s\n", bin.index, bin.starvation_count, bin.starvation_time / 1E6, bin.hold_count, bin.hold_time / 1E6);
+    // NOTE: Each push call saved also saves its need-data wait; the time per call against time per buffer shows what
+    //       a call costs on top of the buffers it carries
+    if (g_batch_count > 1)
+      for (auto&& bin : bin_list)
+        if (bin.push_call_count)
+          g_print ("%u: %" G_GUINT64_FORMAT " buffers in %" G_GUINT64_FORMAT " push calls, %.1f per call, %.2f us per call, %.2f us per buffer, %" G_GUINT64_FORMAT " calls and need-data waits saved\n", bin.index, bin.push_count, bin.push_call_count, static_cast<double> (bin.push_count) / bin.push_call_count, static_cast<double> (bin.push_call_time) / bin.push_call_count, bin.push_count ? static_cast<double> (bin.push_call_time) / bin.push_count : 0.0, bin.push_count - bin.push_call_count);
+    if (const auto pool = reader_list.front ().pool) {
+      std::unique_lock lock (pool->mutex);
+      g_print ("Payload pool: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " trims, peak %" G_GUINT64_FORMAT " bytes outstanding\n", pool->hit_count, pool->miss_count, pool->trim_count, pool->peak_outstanding_size);
+    }
+  }
+  // NOTE: Totals over bins, rates are over time from start of pushing to the last push or sample of any bin
+  Throughput get_throughput () const
+  {
+    Throughput throughput;
+    uint64_t push_count = 0, push_size = 0, sample_count = 0;
+    gint64 push_end_time = start_time, sample_end_time = start_time;
+    for (auto&& bin : bin_list) {
+      push_count += bin.push_count;
+      push_size += bin.push_size;
+      sample_count += bin.sample_count.load ();
+      push_end_time = std::max (push_end_time, bin.push_end_time);
+      sample_end_time = std::max (sample_end_time, bin.last_sample_time.load ());
+      throughput.deadline_miss_count += bin.deadline_miss_count.load ();
+    }
+    if (push_end_time > start_time) {
+      throughput.buffer_rate = push_count * 1E6 / (push_end_time - start_time);
+      throughput.byte_rate = push_size * 1E6 / (push_end_time - start_time);
+    }
+    if (sample_end_time > start_time)
+      throughput.frame_rate = sample_count * 1E6 / (sample_end_time - start_time);
+    return throughput;
+  }
+  // NOTE: Benchmark results, rates are over time from start of pushing to the last push or sample of the bin;
+  //       startup latency (opening the file, building and starting the pipeline) is reported from launch
+  std::string get_benchmark_json (Reader& reader) const
+  {
+    const auto end_time = g_get_monotonic_time ();
+    const auto get_rate = [&] (uint64_t value, gint64 time) { return time > start_time ? value * 1E6 / (time - start_time) : 0.0; };
+    std::ostringstream stream;
+    stream.precision (3);
+    stream << std::fixed;
+    stream << "{\n  \"wall_time\": " << (end_time - start_time) / 1E6 << ",\n  \"cpu_time\": " << (get_cpu_time (false) - start_cpu_time) / 1E6 << ",\n  \"startup_time\": " << (start_time - launch_time) / 1E6 << ",\n  \"bins\": [";
+    for (auto&& bin : bin_list) {
+      stream << (bin.index ? ",\n" : "\n") << "    {\n";
+      stream << "      \"index\": " << bin.index << ",\n";
+      stream << "      \"buffers\": " << bin.push_count << ",\n";
+      stream << "      \"bytes\": " << bin.push_size << ",\n";
+      stream << "      \"first_push_time\": " << (bin.first_push_time > start_time ? (bin.first_push_time - start_time) / 1E6 : 0.0) << ",\n";
+      stream << "      \"launch_first_push_time\": " << (bin.first_push_time ? (bin.first_push_time - launch_time) / 1E6 : 0.0) << ",\n";
+      stream << "      \"push_time\": " << (bin.push_end_time > start_time ? (bin.push_end_time - start_time) / 1E6 : 0.0) << ",\n";
+      stream << "      \"buffers_per_second\": " << get_rate (bin.push_count, bin.push_end_time) << ",\n";
+      stream << "      \"bytes_per_second\": " << get_rate (bin.push_size, bin.push_end_time) << ",\n";
+      stream << "      \"push_cpu_time\": " << bin.push_cpu_time / 1E6 << ",\n";
+      stream << "      \"push_calls\": " << bin.push_call_count << ",\n";
+      stream << "      \"push_call_time\": " << bin.push_call_time / 1E6 << ",\n";
+      stream << "      \"samples\": " << bin.sample_count.load () << ",\n";
+      stream << "      \"frames_per_second\": " << get_rate (bin.sample_count.load (), bin.last_sample_time.load ()) << ",\n";
+      stream << "      \"first_sample_time\": " << (bin.first_sample_time.load () > start_time ? (bin.first_sample_time.load () - start_time) / 1E6 : 0.0) << ",\n";
+      stream << "      \"launch_first_sample_time\": " << (bin.first_sample_time.load () ? (bin.first_sample_time.load () - launch_time) / 1E6 : 0.0) << ",\n";
+      if (g_no_sync)
+        stream << "      \"deadline_misses\": null,\n";
+      else
+        stream << "      \"deadline_misses\": " << bin.deadline_miss_count.load () << ",\n";
+      stream << "      \"first_frame_time\": " << (play_time && bin.first_frame_time.load () > play_time ? (bin.first_frame_time.load () - play_time) / 1E6 : 0.0) << ",\n";
+      stream << "      \"skipped_buffers\": " << bin.skip_count << ",\n";
+      stream << "      \"skipped_bytes\": " << bin.skip_size << ",\n";
+      stream << "      \"skipped_time\": " << bin.skip_time / 1E9 << ",\n";
+      stream << "      \"end_of_stream\": " << (bin.end_of_stream_time.load () ? "true" : "false") << ",\n";
+      stream << "      \"starvation_count\": " << bin.starvation_count << ",\n";
+      stream << "      \"starvation_time\": " << bin.starvation_time / 1E6 << ",\n";
+      stream << "      \"hold_count\": " << bin.hold_count << ",\n";
+      stream << "      \"hold_time\": " << bin.hold_time / 1E6 << "\n";
+      stream << "    }";
+    }
+    stream << "\n  ]";
+    if (loop_list.size () > 1) {
+      stream << ",\n  \"loops\": [";
+      for (size_t index = 0; index < loop_list.size (); index++) {
+        const auto& loop = loop_list[index];
+        stream << (index ? ",\n" : "\n") << "    { \"time\": " << loop.time / 1E6 << ", \"buffers\": " << loop.buffer_count << ", \"bytes_per_second\": " << (loop.time ? loop.size * 1E6 / loop.time : 0.0) << ", \"resident_bytes\": " << loop.resident_size << ", \"pool_outstanding_bytes\": " << loop.pool_outstanding_size << " }";
       }
+      stream << "\n  ]";
     }
+    if (reader.pool) {
+      std::unique_lock lock (reader.pool->mutex);
+      stream << ",\n  \"pool\": { \"hits\": " << reader.pool->hit_count << ", \"misses\": " << reader.pool->miss_count << ", \"trims\": " << reader.pool->trim_count << ", \"peak_outstanding_bytes\": " << reader.pool->peak_outstanding_size << " }";
+    }
+    stream << "\n}";
+    return stream.str ();
+  }
+  // NOTE: Waits while the bin's queue is full by size or time, unless another bin which is still expecting data has
+  //       run dry: the file might interleave streams coarser than the queue bounds, and holding back reading would
+  //       starve that bin
+  void enqueue (Bin& bin, Bin::Item&& item, std::atomic_bool& termination)
+  {
+    std::unique_lock queue_lock (queue_mutex);
+    const auto queue_time = static_cast<GstClockTime> (g_queue_time * GST_SECOND);
+    // NOTE: The budget is waived while another bin starves, i.e. its source needs data and buffers for it are still
+    //       to come, which may be behind this item in the file; up to a hard cap, as the other stream may be sparse
+    //       or end without end of stream
+    const auto available = [&] {
+      if (bin.queue.empty () || termination.load ())
+        return true;
+      if (bin.queue_size + item.size <= g_queue_size && (!queue_time || bin.get_queue_time (item) <= queue_time))
+        return true;
+      if (bin.queue_size + item.size > 4 * static_cast<size_t> (g_queue_size))
+        return false;
+      return std::any_of (bin_list.cbegin (), bin_list.cend (), [&] (auto&& other_bin) { return &other_bin != &bin && other_bin.queue_fed && !other_bin.queue_closed && other_bin.queue.empty () && other_bin.source_data_need.load (); });
+    };
+    if (!available ()) {
+      const auto time = g_get_monotonic_time ();
+      queue_condition.wait (queue_lock, available);
+      bin.hold_count++;
+      bin.hold_time += g_get_monotonic_time () - time;
+    }
+    if (termination.load ()) {
+      if (item.caps)
+        gst_caps_unref (item.caps);
+      if (item.buffer)
+        gst_buffer_unref (item.buffer);
+      return;
+    }
+    bin.queue_started = true;
+    if (item.type == 2)
+      bin.queue_fed = true;
+    if (item.type == 3)
+      bin.queue_closed = true;
+    bin.queue_size += item.size;
+    bin.queue.emplace_back (std::move (item));
+    queue_condition.notify_all ();
   }
 
   static std::string time (GstClockTime value)
@@ -445,8 +1032,28 @@ struct Application {
     GST_DEBUG ("handle_bus_state_changed_message: %s, %s to %s, pending %s\n", GST_MESSAGE_SRC_NAME (message), gst_element_state_get_name (new_state), gst_element_state_get_name (old_state), gst_element_state_get_name (pending_state));
   }
 
+  // NOTE: Statistics of one pass over the input with --loop, time is that of reading which queue bounds keep in step
+  //       with pushing, memory is sampled at the end of the pass
+  struct Loop {
+    gint64 time; // Microseconds
+    uint64_t buffer_count = 0;
+    uint64_t size = 0;
+    uint64_t resident_size = 0;
+    uint64_t pool_outstanding_size = 0;
+  };
+
   GstPipeline* pipeline = nullptr;
   std::list<Bin> bin_list;
+  std::mutex source_mutex; // Guards source of all bins
+  std::condition_variable source_condition;
+  std::mutex queue_mutex; // Guards queues of all bins
+  std::condition_variable queue_condition;
+  GstClockTime pace_origin = GST_CLOCK_TIME_NONE; // Pace time of first buffer with --pace 1, set before it is queued
+  gint64 launch_time = 0; // Monotonic time the application started at, in microseconds
+  std::atomic<gint64> play_time = 0; // Monotonic time the pipeline was set to PLAYING at
+  gint64 start_time = 0; // Monotonic time pushing started at
+  gint64 start_cpu_time = 0;
+  std::vector<Loop> loop_list;
 };
 
 inline void add_debug_output_log_function ()
@@ -474,6 +1081,7 @@ GST_PLUGIN_STATIC_DECLARE (appsink);
 
 int main (int argc, char* argv[])
 {
+  const auto launch_time = g_get_monotonic_time ();
   GError* error = nullptr;
   GOptionContext* context = g_option_context_new ("- GStreamer appsrc testbed");
   g_option_context_add_main_entries (context, g_option_context_entries, GETTEXT_PACKAGE);
@@ -485,6 +1093,19 @@ int main (int argc, char* argv[])
 
   gst_init (&argc, &argv);
 
+  if (g_instance_count > 1) {
+    // NOTE: Fan-out measures throughput on appsinks, N video windows would neither scale nor count frames
+    g_mmap = true;
+    if (g_video_mode == 0)
+      g_video_mode = 1;
+  }
+  if (g_benchmark) {
+    g_no_sync = true;
+    g_pace = 0;
+    if (g_video_mode == 0)
+      g_video_mode = 1;
+  }
+
   GST_DEBUG_CATEGORY_INIT (application_category, "application", 0, "Application specific distinct debug category");
 
 #if defined(WIN32) && !defined(NDEBUG)
@@ -513,50 +1134,170 @@ int main (int argc, char* argv[])
 // }
 #endif
 
-  Application application;
-  application.pipeline = GST_PIPELINE_CAST (gst_pipeline_new ("pipeline"));
-  g_assert_nonnull (application.pipeline);
-  GstBus* bus = gst_element_get_bus (GST_ELEMENT_CAST (application.pipeline));
-  gst_bus_add_signal_watch (bus);
-  g_signal_connect (G_OBJECT (bus), "message::error", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_error_message (bus, message); }), &application);
-  g_signal_connect (G_OBJECT (bus), "message::eos", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_eos_message (bus, message); }), &application);
-  g_signal_connect (G_OBJECT (bus), "message::state-changed", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_state_changed_message (bus, message); }), &application);
+  std::vector<std::string> path_list;
+  for (auto path = g_path; path && *path; path++)
+    path_list.emplace_back (*path);
+  if (path_list.empty ())
+    path_list.emplace_back ("../data/appsrc");
+  for (auto&& path : path_list) {
+    std::replace (path.begin (), path.end (), '/', static_cast<char> (path::preferred_separator));
+    GST_DEBUG ("path %s", path.c_str ());
+  }
+  if (g_bin_count < path_list.size ())
+    g_bin_count = static_cast<guint> (path_list.size ());
+  // NOTE: Every instance has its own pipeline, bins and push threads, and its own readers, one per input file sharing
+  //       a payload pool; with more than one instance they all read from one shared mapping of each file, buffers
+  //       wrap the mapped payloads without copies
+  struct Instance {
+    Application application;
+    std::list<Reader> reader_list;
+    GstBus* bus = nullptr;
+    std::atomic_bool push_thread_termination = false;
+    std::thread push_thread;
+  };
+  g_assert_true (g_instance_count > 0);
+  std::list<Instance> instance_list;
+  std::vector<Mapping*> mapping_list;
+  if (g_instance_count > 1)
+    for (auto&& path : path_list) {
+      const auto mapping = Mapping::create (path);
+      if (!mapping) {
+        g_print ("Failed to open %s\n", path.c_str ());
+        exit (1);
+      }
+      mapping_list.emplace_back (mapping);
+    }
+  for (guint index = 0; index < g_instance_count; index++) {
+    auto& instance = instance_list.emplace_back ();
+    const auto pool = g_no_pool ? nullptr : PayloadPool::create ();
+    for (size_t path_index = 0; path_index < path_list.size (); path_index++) {
+      auto& reader = instance.reader_list.emplace_back ();
+      reader.verify = !g_no_verify;
+      if (pool)
+        reader.pool = pool->ref ();
+      if (!mapping_list.empty ())
+        reader.mapping = mapping_list[path_index]->ref ();
+    }
+    if (pool)
+      PayloadPool::unref (pool);
+  }
+  for (auto&& mapping : mapping_list)
+    Mapping::unref (std::exchange (mapping, nullptr));
+  // NOTE: File open with header, caps and index parsing runs while the pipeline is being built
+  std::string failed_path;
+  std::thread open_thread ([&] {
+    for (auto&& instance : instance_list) {
+      auto path = path_list.cbegin ();
+      for (auto&& reader : instance.reader_list) {
+        if (!reader.open (*path, g_mmap))
+          failed_path = *path;
+        path++;
+      }
+    }
+  });
 
   g_assert_true (g_bin_count > 0);
-  for (guint index = 0; index < g_bin_count; index++) {
-    auto& bin = application.bin_list.emplace_back ();
-    bin.application = &application;
-    bin.index = index;
-    bin.create_playbin ();
-    bin.create_sink ();
-    gst_bin_add (GST_BIN (application.pipeline), bin.playbin);
-    gst_element_sync_state_with_parent (bin.playbin);
+  for (auto&& instance : instance_list) {
+    auto& application = instance.application;
+    application.launch_time = launch_time;
+    application.pipeline = GST_PIPELINE_CAST (gst_pipeline_new ("pipeline"));
+    g_assert_nonnull (application.pipeline);
+    auto& bus = instance.bus;
+    bus = gst_element_get_bus (GST_ELEMENT_CAST (application.pipeline));
+    gst_bus_add_signal_watch (bus);
+    g_signal_connect (G_OBJECT (bus), "message::error", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_error_message (bus, message); }), &application);
+    g_signal_connect (G_OBJECT (bus), "message::eos", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_eos_message (bus, message); }), &application);
+    g_signal_connect (G_OBJECT (bus), "message::state-changed", G_CALLBACK (+[] (GstBus* bus, GstMessage* message, Application* application) -> void { application->handle_bus_state_changed_message (bus, message); }), &application);
+
+    for (guint index = 0; index < g_bin_count; index++) {
+      auto& bin = application.bin_list.emplace_back ();
+      bin.application = &application;
+      bin.index = index;
+      bin.create_playbin ();
+      bin.create_sink ();
+      gst_bin_add (GST_BIN (application.pipeline), bin.playbin);
+      gst_element_sync_state_with_parent (bin.playbin);
+    }
+  }
+
+  open_thread.join ();
+  if (!failed_path.empty ()) {
+    g_print ("Failed to open %s\n", failed_path.c_str ());
+    exit (1);
   }
 
-  std::string path = g_path ? g_path : "../data/appsrc";
-  std::replace (path.begin (), path.end (), '/', static_cast<char> (path::preferred_separator));
-  GST_DEBUG ("path %s", path.c_str ());
-  std::atomic_bool push_thread_termination = false;
-  std::thread push_thread ([&] { application.push (push_thread_termination, path); });
-
-  set_pipeline_state (application.pipeline, GST_STATE_PLAYING);
-  auto message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE, static_cast<GstMessageType> (GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
-  // NOTE: https://gstreamer.freedesktop.org/documentation/tutorials/basic/debugging-tools.html#getting-pipeline-graphs
-  //       https://dreampuf.github.io/GraphvizOnline
-  GST_DEBUG_BIN_TO_DOT_FILE (GST_BIN_CAST (application.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "gstreamer_appsrcsandbox");
-  g_assert_true (message != nullptr);
-  g_assert_true (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS);
-  gst_message_unref (std::exchange (message, nullptr));
-
-  push_thread_termination.store (true);
-  for (auto&& bin : application.bin_list)
-    bin.source_data_condition.notify_all ();
-  push_thread.join ();
-
-  gst_bus_remove_signal_watch (bus);
-  gst_object_unref (std::exchange (bus, nullptr));
-
-  gst_element_set_state (GST_ELEMENT_CAST (application.pipeline), GST_STATE_NULL);
+  for (auto&& instance : instance_list)
+    instance.push_thread = std::thread ([&] { instance.application.push (instance.push_thread_termination, instance.reader_list); });
+
+  for (auto&& instance : instance_list) {
+    instance.application.play_time = g_get_monotonic_time ();
+    set_pipeline_state (instance.application.pipeline, GST_STATE_PLAYING);
+  }
+  for (auto&& instance : instance_list) {
+    auto message = gst_bus_timed_pop_filtered (instance.bus, GST_CLOCK_TIME_NONE, static_cast<GstMessageType> (GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+    // NOTE: https://gstreamer.freedesktop.org/documentation/tutorials/basic/debugging-tools.html#getting-pipeline-graphs
+    //       https://dreampuf.github.io/GraphvizOnline
+    GST_DEBUG_BIN_TO_DOT_FILE (GST_BIN_CAST (instance.application.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "gstreamer_appsrcsandbox");
+    g_assert_true (message != nullptr);
+    g_assert_true (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS);
+    gst_message_unref (std::exchange (message, nullptr));
+  }
+
+  for (auto&& instance : instance_list) {
+    auto& application = instance.application;
+    instance.push_thread_termination.store (true);
+    {
+      std::unique_lock source_lock (application.source_mutex);
+      application.source_condition.notify_all ();
+    }
+    for (auto&& bin : application.bin_list)
+      bin.source_data_condition.notify_all ();
+    {
+      std::unique_lock queue_lock (application.queue_mutex);
+      application.queue_condition.notify_all ();
+    }
+    instance.push_thread.join ();
+  }
+  {
+    auto path = path_list.cbegin ();
+    for (auto&& reader : instance_list.front ().reader_list) {
+      if (reader.corrupt_count)
+        g_print ("%s: %" G_GUINT64_FORMAT " ranges of corrupt data skipped, %" G_GUINT64_FORMAT " bytes\n", path->c_str (), reader.corrupt_count, reader.corrupt_size);
+      path++;
+    }
+  }
+  if (instance_list.size () > 1) {
+    // NOTE: Aggregate is the sum of instance rates, frame rates and deadline misses falling short show saturation
+    Application::Throughput aggregate;
+    std::ostringstream stream;
+    stream.precision (3);
+    stream << std::fixed << "{\n  \"instances\": [";
+    guint index = 0;
+    for (auto&& instance : instance_list) {
+      const auto throughput = instance.application.get_throughput ();
+      aggregate.buffer_rate += throughput.buffer_rate;
+      aggregate.byte_rate += throughput.byte_rate;
+      aggregate.frame_rate += throughput.frame_rate;
+      aggregate.deadline_miss_count += throughput.deadline_miss_count;
+      if (g_benchmark)
+        stream << (index ? ",\n" : "\n") << instance.application.get_benchmark_json (instance.reader_list.front ());
+      else
+        g_print ("Instance %u: %.1f buffers/s, %.1f MB/s, %.1f frames/s, %s deadline misses\n", index, throughput.buffer_rate, throughput.byte_rate / 1E6, throughput.frame_rate, g_no_sync ? "n/a" : std::to_string (throughput.deadline_miss_count).c_str ());
+      index++;
+    }
+    if (g_benchmark) {
+      stream << "\n  ],\n  \"aggregate\": { \"instances\": " << index << ", \"buffers_per_second\": " << aggregate.buffer_rate << ", \"bytes_per_second\": " << aggregate.byte_rate << ", \"frames_per_second\": " << aggregate.frame_rate << ", \"deadline_misses\": " << (g_no_sync ? std::string ("null") : std::to_string (aggregate.deadline_miss_count)) << " }\n}";
+      g_print ("%s\n", stream.str ().c_str ());
+    } else
+      g_print ("All %u instances: %.1f buffers/s, %.1f MB/s, %.1f frames/s, %s deadline misses\n", index, aggregate.buffer_rate, aggregate.byte_rate / 1E6, aggregate.frame_rate, g_no_sync ? "n/a" : std::to_string (aggregate.deadline_miss_count).c_str ());
+  } else if (g_benchmark)
+    g_print ("%s\n", instance_list.front ().application.get_benchmark_json (instance_list.front ().reader_list.front ()).c_str ());
+
+  for (auto&& instance : instance_list) {
+    gst_bus_remove_signal_watch (instance.bus);
+    gst_object_unref (std::exchange (instance.bus, nullptr));
+    gst_element_set_state (GST_ELEMENT_CAST (instance.application.pipeline), GST_STATE_NULL);
+  }
 
   return 0;
 }
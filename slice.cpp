@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <string>
+
+#include <gst/gst.h>
+
+#define GETTEXT_PACKAGE "gstreamer_appsrcsandbox"
+
+// Commandline option parser https://developer-old.gnome.org/glib/unstable/glib-Commandline-option-parser.html
+
+static gchar* g_path = nullptr;
+static gchar* g_output_path = nullptr;
+static gdouble g_start = -1.0;
+static gdouble g_end = -1.0;
+static gchar* g_stream = nullptr;
+
+static GOptionEntry g_option_context_entries[] {
+  { "path", 'p', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &g_path, "Path to record file to slice", nullptr },
+  { "output", 'o', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &g_output_path, "Path to record file to write", nullptr },
+  { "start", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_start, "Start each stream from its key frame preceding given time in seconds", nullptr },
+  { "end", 0, G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_DOUBLE, &g_end, "End each stream at given time in seconds", nullptr },
+  { "stream", 's', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_STRING, &g_stream, "Comma separated element identifiers of streams to keep, renumbered from 0 in given order", nullptr },
+  { nullptr }
+};
+
+GST_DEBUG_CATEGORY_STATIC (slice_category);
+#define GST_CAT_DEFAULT slice_category
+
+#include "reader.h"
+
+int main (int argc, char* argv[])
+{
+  GError* error = nullptr;
+  GOptionContext* context = g_option_context_new ("- appsrc record file slicing");
+  g_option_context_add_main_entries (context, g_option_context_entries, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_print ("Command line parse failed: %s\n", error->message);
+    exit (1);
+  }
+
+  gst_init (&argc, &argv);
+
+  GST_DEBUG_CATEGORY_INIT (slice_category, "slice", 0, "Record file slicing");
+
+  if (!g_path || !g_output_path) {
+    g_print ("Usage: slice --path <file> --output <file> [--start <seconds>] [--end <seconds>] [--stream <identifier>,...]\n");
+    exit (1);
+  }
+  const std::string path = g_path;
+
+  // NOTE: Identifier of each stream in the output, streams mapped to -1 are dropped
+  int identifier_list[256];
+  std::fill (std::begin (identifier_list), std::end (identifier_list), -1);
+  std::vector<uint8_t> selection_list;
+  if (g_stream) {
+    gchar** string_list = g_strsplit (g_stream, ",", -1);
+    for (auto string = string_list; *string; string++) {
+      const auto value = g_ascii_strtoull (*string, nullptr, 10);
+      if (value > 255 || identifier_list[value] >= 0) {
+        g_print ("Invalid stream %s\n", *string);
+        exit (1);
+      }
+      identifier_list[value] = static_cast<int> (selection_list.size ());
+      selection_list.push_back (static_cast<uint8_t> (value));
+    }
+    g_strfreev (string_list);
+  } else
+    for (int element_identifier = 0; element_identifier < 256; element_identifier++)
+      identifier_list[element_identifier] = element_identifier;
+
+  Reader reader;
+  if (!reader.open (path, true)) {
+    g_print ("Failed to open %s\n", path.c_str ());
+    exit (1);
+  }
+#if defined(WIN32)
+  const auto descriptor = _open (path.c_str (), _O_BINARY | _O_RDONLY);
+#else
+  const auto descriptor = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+#endif
+  if (descriptor < 0) {
+    g_print ("Failed to open %s\n", path.c_str ());
+    exit (1);
+  }
+  const auto start_time = g_get_monotonic_time ();
+
+  // NOTE: Caps each stream starts with, from the header and overridden by the caps in effect at its start key frame
+  std::map<uint8_t, GstCaps*> caps_map;
+  for (auto&& element : reader.stream_table)
+    if (identifier_list[element.first] >= 0 && reader.get_caps (element.second))
+      caps_map[element.first] = reader.get_caps (element.second);
+
+  // NOTE: As in replay, streams start on a key frame
+  std::vector<Reader::StartFilter> start_filter_list (256);
+  Reader::Start start { std::make_pair (reader.data_offset, static_cast<uint32_t> (0)) };
+  if (g_start >= 0) {
+    start = reader.find_start (static_cast<GstClockTime> (g_start * GST_SECOND), [&] (uint8_t element_identifier) { return identifier_list[element_identifier] >= 0; });
+    for (auto&& key_frame : start.key_frame_list) {
+      if (key_frame.caps)
+        caps_map[key_frame.element_identifier] = key_frame.caps;
+      start_filter_list[key_frame.element_identifier].key_frame_time = key_frame.time;
+    }
+    if (!start.key_frame_list.empty ())
+      GST_INFO ("Starting from offset %" G_GUINT64_FORMAT "+%u for time %.3f", start.position.first, start.position.second, g_start);
+    else
+      GST_WARNING ("No key frames found, slicing from the beginning");
+  }
+  reader.seek_start (start);
+
+  // NOTE: Output keeps the record format of the input except for compression, compressed blocks cannot be copied
+  //       by range and their payloads are written out uncompressed; checksums of payloads copied by range are taken
+  //       over the mapping
+  AppsrcFile file;
+  file.path = g_output_path;
+  file.compact = (reader.flags & AppsrcFile::g_compact_flag) != 0;
+  file.arrival = (reader.flags & AppsrcFile::g_arrival_flag) != 0;
+  file.checksum = (reader.flags & AppsrcFile::g_checksum_flag) != 0;
+  file.index = true;
+  for (auto&& element : caps_map)
+    file.declare_stream (static_cast<uint8_t> (identifier_list[element.first]), element.second);
+  file.open ();
+  if (file.output.descriptor < 0) {
+    g_print ("Failed to open %s\n", g_output_path);
+    exit (1);
+  }
+  for (auto&& element : caps_map)
+    file.handle_caps (element.second, static_cast<uint8_t> (identifier_list[element.first]));
+
+  // NOTE: Streams are done with their first buffer at or past the end time, or their end of stream; reading stops
+  //       once all streams selected or seen so far are done
+  const auto end_time = g_end >= 0 ? static_cast<GstClockTime> (g_end * GST_SECOND) : GST_CLOCK_TIME_NONE;
+  std::map<uint8_t, bool> end_map;
+  for (auto&& element_identifier : selection_list)
+    end_map[element_identifier] = false;
+  for (auto&& element : caps_map)
+    end_map.emplace (element.first, false);
+  GstClockTime arrival_origin = GST_CLOCK_TIME_NONE;
+  uint64_t buffer_count = 0, size = 0, copy_size = 0, skip_count = 0;
+  Reader::Record record;
+  while (reader.next (record)) {
+    const auto identifier = identifier_list[record.element_identifier];
+    if (identifier < 0)
+      continue;
+    const auto element_identifier = static_cast<uint8_t> (identifier);
+    auto& end = end_map.emplace (record.element_identifier, false).first->second;
+    if (end)
+      continue;
+    switch (record.type) {
+      case 1:
+        file.handle_caps (record.caps, element_identifier);
+        break;
+      case 2: {
+        const auto time = static_cast<GstClockTime> (record.dts != -1 ? record.dts : record.pts);
+        if (GST_CLOCK_TIME_IS_VALID (end_time) && GST_CLOCK_TIME_IS_VALID (time) && time >= end_time) {
+          file.handle_end_of_stream (element_identifier);
+          end = true;
+          break;
+        }
+        if (start_filter_list[record.element_identifier].skip (record)) {
+          skip_count++;
+          break;
+        }
+        // NOTE: Arrival times are kept relative to the first buffer written
+        gint64 arrival_time = file.arrival_origin;
+        if (GST_CLOCK_TIME_IS_VALID (record.arrival)) {
+          if (!GST_CLOCK_TIME_IS_VALID (arrival_origin))
+            arrival_origin = record.arrival;
+          arrival_time += static_cast<gint64> ((record.arrival - std::min (record.arrival, arrival_origin)) / GST_USECOND);
+        }
+        // NOTE: Payloads go from file to file by range, the buffer carries metadata only; payloads which are staged
+        //       anyway (below Output::g_direct_size) are wrapped in place and decompressed ones are copied
+        const auto range = record.offset && record.size >= AppsrcFile::Output::g_direct_size;
+        GstBuffer* buffer;
+        if (!range && record.mapped_data)
+          buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, const_cast<uint8_t*> (record.mapped_data), record.mapped_size, 0, record.mapped_size, nullptr, nullptr);
+        else if (!range && !record.data.empty ()) {
+          buffer = gst_buffer_new_allocate (nullptr, record.data.size (), nullptr);
+          gst_buffer_fill (buffer, 0, record.data.data (), record.data.size ());
+        } else
+          buffer = gst_buffer_new ();
+        GST_BUFFER_FLAGS (buffer) = static_cast<guint> (record.flags);
+        GST_BUFFER_DTS (buffer) = static_cast<GstClockTime> (record.dts);
+        GST_BUFFER_PTS (buffer) = static_cast<GstClockTime> (record.pts);
+        GST_BUFFER_DURATION (buffer) = static_cast<GstClockTime> (record.duration);
+        if (range) {
+          file.write_buffer_range (buffer, element_identifier, arrival_time, descriptor, record.offset, static_cast<uint32_t> (record.size), record.mapped_data);
+          copy_size += record.size;
+        } else {
+          file.write_buffer (buffer, element_identifier, 0, arrival_time);
+          if (file.output.attached_size)
+            file.output.flush ();
+        }
+        gst_buffer_unref (buffer);
+        buffer_count++;
+        size += record.size;
+      } break;
+      case 3:
+        file.handle_end_of_stream (element_identifier);
+        end = true;
+        break;
+    }
+    if (end && std::all_of (end_map.cbegin (), end_map.cend (), [] (auto&& element) { return element.second; }))
+      break;
+  }
+  file.close ();
+#if defined(WIN32)
+  _close (descriptor);
+#else
+  ::close (descriptor);
+#endif
+  const auto slice_time = g_get_monotonic_time () - start_time;
+  g_print ("%s: %" G_GUINT64_FORMAT " buffers, %.3f MB (%.3f MB copied by range), %" G_GUINT64_FORMAT " buffers in front of key frames skipped, %zu streams, %.3f s\n", g_output_path, buffer_count, size / 1E6, copy_size / 1E6, skip_count, end_map.size (), slice_time / 1E6);
+  return 0;
+}